@@ -7,12 +7,21 @@
  * Bios loader for the PSX.
  */
 
+#include <cstring>
 #include <fstream>
 #include <vector>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "imgui/imgui.h"
 
 #include "bios.hh"
+#include "mem/arena.hh"
+#include "mem/fastmem.hh"
 #include "util/psxlog.hh"
 #include "view/imgui/dbgmod.hh"
 
@@ -23,12 +32,130 @@
 namespace {
 
 struct State {
-    std::vector<u8> rom;
+    // lives in the arena
+    u8 *rom = nullptr;
     std::string bios_path;
     bool bios_loaded = false;
+    // rom is a read-only mapping of the file
+    bool mapped = false;
     Psx::View::ImGuiLayer::DbgMod::HexDump hexdump;
 } s;
 
+// images that have already been checked, by file identity
+struct CheckedImage {
+    std::string path;
+    u64 size;
+    i64 mtime;
+    u32 crc;
+};
+std::vector<CheckedImage> checked_images;
+
+// crc32 of known good images
+constexpr struct {
+    u32 crc;
+    const char *name;
+} KnownImages[] = {
+    {0x3715'7331, "SCPH-1001 (v2.2 NTSC-U)"},
+};
+
+u32 crc32(const u8 *data, size_t size)
+{
+    u32 crc = 0xffff'ffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb8'8320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+/*
+ * Map the file over the BIOS region of the arena. Returns false if it can't
+ * be mapped, and the file needs to be read instead.
+ */
+bool mapFile(const std::string& path)
+{
+#ifdef _WIN32
+    (void) path;
+    return false;
+#else
+    using namespace Psx;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        BIOS_ERROR("Failed to open BIOS from {}", path);
+        throw std::runtime_error(PSX_FMT("Failed to open BIOS from {}", path));
+    }
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && static_cast<u64>(st.st_size) >= Arena::BiosSize
+        && Arena::MapFile(Arena::BiosOffset, Arena::BiosSize, fd);
+    if (ok) {
+        Fastmem::MapBios(fd);
+        s.mapped = true;
+        BIOS_INFO("Mapped {} read-only", path);
+    }
+    // the mappings keep the file alive
+    close(fd);
+    return ok;
+#endif
+}
+
+/*
+ * Read the file into the BIOS region of the arena.
+ */
+void readFile(const std::string& path)
+{
+    using namespace Psx;
+    if (s.mapped) {
+        // get the writable arena memory back
+        Arena::UnmapFile(Arena::BiosOffset, Arena::BiosSize);
+        Fastmem::MapBios(-1);
+        s.mapped = false;
+    }
+    std::ifstream file;
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) {
+        BIOS_ERROR("Failed to open BIOS from {}", path);
+        throw std::runtime_error(PSX_FMT("Failed to open BIOS from {}", path));
+    }
+    std::memset(s.rom, 0, Arena::BiosSize);
+    file.read(reinterpret_cast<char*>(s.rom), Arena::BiosSize);
+    file.close();
+}
+
+/*
+ * Check the loaded image against the known good ones. Only done once per
+ * file, reloading the same unchanged file skips it.
+ */
+void checkImage(const std::string& path)
+{
+    using namespace Psx;
+    u64 size = 0;
+    i64 mtime = 0;
+#ifndef _WIN32
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        size = static_cast<u64>(st.st_size);
+        mtime = st.st_mtime;
+    }
+#endif
+    for (const CheckedImage& image : checked_images) {
+        if (image.path == path && image.size == size && image.mtime == mtime) {
+            return;
+        }
+    }
+
+    u32 crc = crc32(s.rom, Arena::BiosSize);
+    checked_images.push_back({path, size, mtime, crc});
+    for (const auto& known : KnownImages) {
+        if (known.crc == crc) {
+            BIOS_INFO("BIOS is {}", known.name);
+            return;
+        }
+    }
+    BIOS_WARN("Unknown BIOS image (crc32 {:08x})", crc);
+}
+
 }// end namespace
 
 namespace Psx {
@@ -37,7 +164,7 @@ namespace Bios {
 void Init()
 {
     BIOS_INFO("Initializing state");
-    s.rom.resize(1024 * 512, 0);
+    s.rom = Arena::BiosBase();
 }
 
 void Init(const std::string& path)
@@ -70,7 +197,8 @@ bool IsLoaded()
 }
 
 /*
- * Load BIOS from the path specified.
+ * Load BIOS from the path specified. The file gets mapped read-only when
+ * possible, so every instance on the host shares one copy of it.
  */
 void LoadFromFile(const std::string& path)
 {
@@ -81,21 +209,20 @@ void LoadFromFile(const std::string& path)
 
     BIOS_INFO("Loading BIOS from {}", path);
     s.bios_path = path;
-    // open file
-    std::ifstream file;
-    file.open(path, std::ios::binary);
-    if (!file.is_open()) {
-        BIOS_ERROR("Failed to open BIOS from {}", path);
-        throw std::runtime_error(PSX_FMT("Failed to open BIOS from {}", path));
+    if (!mapFile(path)) {
+        readFile(path);
     }
-
-    // dump bytes into local rom
-    file.read((char*) s.rom.data(), s.rom.size());
-
-    file.close();
     s.bios_loaded = true;
+    checkImage(path);
 }
 
+/*
+ * Pointer to the start of the 512KB ROM on the host. Stays valid after Init.
+ */
+const u8* HostPtr()
+{
+    return s.rom;
+}
 
 /*
  * To be called on every ImGui update while the debug window is active.
@@ -107,7 +234,7 @@ void OnActive(bool *active)
         return;
     }
 
-    s.hexdump.Update(s.rom);
+    s.hexdump.Update({s.rom, Arena::BiosSize});
 
     ImGui::End();
 }
@@ -117,27 +244,8 @@ template<class T>
 T Read(u32 addr)
 {
     u32 maddr = addr & 0x0007'ffff; // addr % 512K
-    T data = 0;
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.rom.size());
-        // read8
-        data = s.rom[maddr];
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.rom.size() - 2);
-        // read16 as little endian
-        data  = s.rom[maddr];
-        data |= static_cast<u16>(s.rom[maddr + 1]) << 8;
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.rom.size() - 4);
-        // read32 as little endian
-        data  = s.rom[maddr];
-        data |= static_cast<u32>(s.rom[maddr + 1]) << 8;
-        data |= static_cast<u32>(s.rom[maddr + 2]) << 16;
-        data |= static_cast<u32>(s.rom[maddr + 3]) << 24;
-    } else {
-        static_assert(!std::is_same_v<T, T>);
-    }
-    return data;
+    PSX_ASSERT(maddr <= Arena::BiosSize - sizeof(T));
+    return Util::LoadLE<T>(s.rom + maddr);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template u8 Read<u8>(u32 addr);
@@ -148,29 +256,8 @@ template u32 Read<u32>(u32 addr);
 template<class T>
 void Write(T data, u32 addr)
 {
-    BIOS_ERROR("Trying to write [{:x}] to ROM @ 0x{:08x}", data, addr);
-    PSX_ASSERT(0);
-    // TODO Check for cache enable
-    u32 maddr = addr & 0x0007'ffff; // addr % 512K
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.rom.size());
-        // write8
-        s.rom[maddr] = data;
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.rom.size() - 2);
-        // write16 as little endian
-        s.rom[maddr + 0] = static_cast<u8>(data);
-        s.rom[maddr + 1] = static_cast<u8>(data >> 8);
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.rom.size() - 4);
-        // write32 as little endian
-        s.rom[maddr + 0] = static_cast<u8>(data);
-        s.rom[maddr + 1] = static_cast<u8>(data >> 8);
-        s.rom[maddr + 2] = static_cast<u8>(data >> 16);
-        s.rom[maddr + 3] = static_cast<u8>(data >> 24);
-    } else {
-        static_assert(!std::is_same_v<T, T>);
-    }
+    // the ROM may be a read-only mapping, so the write is always dropped
+    BIOS_WARN("Dropping write of [{:x}] to ROM @ 0x{:08x}", data, addr);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template void Write<u8>(u8 data, u32 addr);
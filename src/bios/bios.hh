@@ -33,6 +33,9 @@ T Read(u32 addr);
 template<class T>
 void Write(T data, u32 addr);
 
+// backing memory, for direct reads from the bus
+const u8* HostPtr();
+
 }// end namespace
 }
 
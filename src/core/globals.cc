@@ -2,5 +2,8 @@
 
 EmuState g_emu_state = {
     .paused = false,
-    .step_count = 0
+    .step_count = 0,
+    .speed = 1.0f,
+    .turbo = false,
+    .frame_skip = 8
 };
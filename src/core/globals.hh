@@ -17,6 +17,11 @@
 struct EmuState {
     bool paused = false;
     u32 step_count = 0;
+    // guest speed as a multiple of real time
+    float speed = 1.0f;
+    // run as fast as the host allows, only showing every frame_skip'th frame
+    bool turbo = false;
+    u32 frame_skip = 8;
 };
 
 extern EmuState g_emu_state;
@@ -10,6 +10,8 @@
 #include "core/config.hh"
 #include "core/globals.hh"
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <memory>
@@ -26,6 +28,7 @@
 #include "util/psxutil.hh"
 #include "core/sys.hh"
 #include "cpu/cpu.hh"
+#include "cpu/transcache.hh"
 
 #define MAIN_INFO(...) PSXLOG_INFO("Main", __VA_ARGS__)
 #define MAIN_WARN(...) PSXLOG_WARN("Main", __VA_ARGS__)
@@ -36,6 +39,11 @@ int main()
     // init global emulation state
     g_emu_state.paused = false;
     g_emu_state.step_count = 0;
+    // PSX_TURBO=<n> runs unthrottled, showing every nth frame
+    if (const char *turbo = std::getenv("PSX_TURBO")) {
+        g_emu_state.turbo = true;
+        g_emu_state.frame_skip = static_cast<u32>(std::max(1, std::atoi(turbo)));
+    }
 
     // init the logger
     Psx::Log::Init(std::cerr, true);
@@ -59,10 +67,16 @@ int main()
     std::string bios_path;
     bios_path.append(PROJECT_ROOT_PATH);
     bios_path.append("/bios/SCPH1001.BIN");
+    // profile of hot blocks from earlier runs
+    std::string tcache_path;
+    tcache_path.append(PROJECT_ROOT_PATH);
+    tcache_path.append("/psx.tcache");
     try {
         // create main System object
         Psx::System psx(bios_path, false);
+        Psx::Cpu::TransCache::Load(tcache_path);
         psx.Run();
+        Psx::Cpu::TransCache::Save(tcache_path);
     } catch (std::runtime_error& re) {
         std::cerr << "Runtime error: " << re.what() << std::endl;
         rc = 1;
@@ -0,0 +1,228 @@
+/*
+ * scheduler.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Keeps the global cycle count and a min-heap of pending device events
+ * ordered by the cycle they are due. The system runs the cpu in slices that
+ * end at the earliest event, then advances time and fires whatever is due,
+ * so devices only run when they have something to do.
+ *
+ * Time only moves forward in Advance, the cpu's progress inside its current
+ * slice is added on top (see Cpu::CyclesThisRun) so devices looking at the
+ * time in the middle of a slice see the exact cycle.
+ */
+
+#include "core/scheduler.hh"
+
+#include <algorithm>
+#include <vector>
+
+#include "cpu/cpu.hh"
+#include "util/psxlog.hh"
+
+#define SCHED_INFO(...) PSXLOG_INFO("Scheduler", __VA_ARGS__)
+#define SCHED_WARN(...) PSXLOG_WARN("Scheduler", __VA_ARGS__)
+#define SCHED_ERROR(...) PSXLOG_ERROR("Scheduler", __VA_ARGS__)
+
+constexpr u32 NotScheduled = ~0u;
+
+// *** Private Data and Helpers ***
+namespace  {
+using Psx::Scheduler::EventHandle;
+
+struct Event {
+    const char *name = nullptr;
+    Psx::Scheduler::Callback callback = nullptr;
+    u64 when = 0;
+    // position in the heap, NotScheduled when not in it
+    u32 heap_index = NotScheduled;
+};
+
+struct State {
+    std::vector<Event> events;
+    // binary min-heap of events ordered by when
+    std::vector<EventHandle> heap;
+    u64 now = 0;
+    // where the cpu slice handed out by NextSlice ends
+    u64 slice_end = 0;
+} s;
+
+inline u64 when(EventHandle event)
+{
+    return s.events[event].when;
+}
+
+inline void place(u32 index, EventHandle event)
+{
+    s.heap[index] = event;
+    s.events[event].heap_index = index;
+}
+
+void siftUp(u32 index)
+{
+    EventHandle event = s.heap[index];
+    while (index > 0) {
+        u32 parent = (index - 1) / 2;
+        if (when(s.heap[parent]) <= when(event)) {
+            break;
+        }
+        place(index, s.heap[parent]);
+        index = parent;
+    }
+    place(index, event);
+}
+
+void siftDown(u32 index)
+{
+    EventHandle event = s.heap[index];
+    u32 size = static_cast<u32>(s.heap.size());
+    while (2 * index + 1 < size) {
+        u32 child = 2 * index + 1;
+        if (child + 1 < size && when(s.heap[child + 1]) < when(s.heap[child])) {
+            child++;
+        }
+        if (when(event) <= when(s.heap[child])) {
+            break;
+        }
+        place(index, s.heap[child]);
+        index = child;
+    }
+    place(index, event);
+}
+
+void remove(EventHandle event)
+{
+    u32 index = s.events[event].heap_index;
+    s.events[event].heap_index = NotScheduled;
+    EventHandle last = s.heap.back();
+    s.heap.pop_back();
+    if (last == event) {
+        return;
+    }
+    place(index, last);
+    siftUp(index);
+    siftDown(s.events[last].heap_index);
+}
+}// end namespace
+
+namespace Psx {
+namespace Scheduler {
+
+void Init()
+{
+    SCHED_INFO("Initializing state");
+    s = {};
+}
+
+/*
+ * Back to cycle 0 with nothing scheduled. Registered events stay, devices
+ * schedule them again on their own reset.
+ */
+void Reset()
+{
+    SCHED_INFO("Resetting state");
+    for (Event& event : s.events) {
+        event.heap_index = NotScheduled;
+    }
+    s.heap.clear();
+    s.now = 0;
+    s.slice_end = 0;
+}
+
+EventHandle Register(const char *name, Callback callback)
+{
+    for (EventHandle handle = 0; handle < s.events.size(); handle++) {
+        // devices can be initialized more than once
+        if (s.events[handle].callback == callback) {
+            return handle;
+        }
+    }
+    s.events.push_back({name, callback});
+    return static_cast<EventHandle>(s.events.size() - 1);
+}
+
+void Schedule(EventHandle event, u32 cycles)
+{
+    ScheduleAt(event, Now() + cycles);
+}
+
+/*
+ * Fire the event at the given cycle, replacing wherever it was scheduled
+ * before. Ends the cpu's slice early if the event is due before it would
+ * have ended. A cycle in the past fires on the next Advance.
+ */
+void ScheduleAt(EventHandle event, u64 cycle)
+{
+    Event& e = s.events[event];
+    e.when = cycle;
+    if (e.heap_index == NotScheduled) {
+        s.heap.push_back(event);
+        siftUp(static_cast<u32>(s.heap.size() - 1));
+    } else {
+        siftUp(e.heap_index);
+        siftDown(e.heap_index);
+    }
+    if (e.when < s.slice_end) {
+        Cpu::RequestExit();
+    }
+}
+
+void Cancel(EventHandle event)
+{
+    if (s.events[event].heap_index != NotScheduled) {
+        remove(event);
+    }
+}
+
+bool IsScheduled(EventHandle event)
+{
+    return s.events[event].heap_index != NotScheduled;
+}
+
+/*
+ * Current cycle.
+ */
+u64 Now()
+{
+    return s.now + Cpu::CyclesThisRun();
+}
+
+/*
+ * Number of cycles the cpu can run before the next event is due, at most
+ * max_cycles. 0 when an event is already due.
+ */
+u32 NextSlice(u32 max_cycles)
+{
+    u32 slice = max_cycles;
+    if (!s.heap.empty()) {
+        u64 next = when(s.heap[0]);
+        slice = next <= s.now ? 0 : static_cast<u32>(std::min<u64>(max_cycles, next - s.now));
+    }
+    s.slice_end = s.now + slice;
+    return slice;
+}
+
+/*
+ * Move time forward by the cycles the cpu ran and fire every event that is
+ * due by then, in order. While an event fires the time is the cycle it was
+ * due, so devices see exactly when it happened, and it's told how far the
+ * cpu already is past that. Events scheduled by the callbacks fire too if
+ * they are already due.
+ */
+void Advance(u32 cycles)
+{
+    u64 end = s.now + cycles;
+    s.slice_end = end;
+    while (!s.heap.empty() && when(s.heap[0]) <= end) {
+        EventHandle event = s.heap[0];
+        s.now = std::max(s.now, when(event));
+        remove(event);
+        s.events[event].callback(static_cast<u32>(end - s.now));
+    }
+    s.now = end;
+}
+
+}// end namespace
+}
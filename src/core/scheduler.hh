@@ -0,0 +1,41 @@
+/*
+ * scheduler.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Cycle timestamped events for the hardware outside the cpu.
+ */
+
+#pragma once
+
+#include "util/psxutil.hh"
+
+namespace Psx {
+namespace Scheduler {
+
+// Called once the event's cycle is reached, with how many cycles the cpu ran
+// past it (it only stops between instructions or blocks). Now() is the
+// event's cycle while it runs.
+using Callback = void (*)(u32 cycles_late);
+using EventHandle = u32;
+
+void Init();
+void Reset();
+
+// devices register their events once on init, the handle stays valid
+// across resets
+EventHandle Register(const char *name, Callback callback);
+// (re)schedule the event to fire after the given number of cycles
+void Schedule(EventHandle event, u32 cycles);
+// (re)schedule the event to fire at the given cycle
+void ScheduleAt(EventHandle event, u64 cycle);
+void Cancel(EventHandle event);
+bool IsScheduled(EventHandle event);
+
+u64 Now();
+u32 NextSlice(u32 max_cycles);
+void Advance(u32 cycles);
+
+}// end namespace
+}
@@ -8,6 +8,8 @@
  * all hardward at once.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <random>
 
@@ -20,10 +22,13 @@
 #include "cpu/cpu.hh"
 #include "cpu/cop0.hh"
 #include "core/globals.hh"
+#include "core/scheduler.hh"
 #include "bios/bios.hh"
 #include "mem/memcontrol.hh"
 #include "mem/scratchpad.hh"
 #include "mem/dma.hh"
+#include "mem/arena.hh"
+#include "mem/fastmem.hh"
 #include "view/imgui/dbgmod.hh"
 #include "cpu/asm/asm.hh"
 #include "cpu/interrupt.hh"
@@ -53,16 +58,23 @@ System::System(const std::string& bios_path, bool headless_mode)
         View::Init();
     }
     SYS_INFO("Initializing all System Modules");
-    Bus::Init();
+    // provides the memory for everything else, so it comes first
+    Arena::Init();
+    // devices register their events on init
+    Scheduler::Init();
+    Fastmem::Init();
     Ram::Init();
     Dma::Init();
     Scratchpad::Init();
     MemControl::Init();
     Cpu::Init();
+    // the gpu drives the timers, so they come first
+    Timer::Init();
     Gpu::Init();
     Cop0::Init();
     Bios::Init(bios_path);
-    Timer::Init();
+    // maps the memory above, so it comes after
+    Bus::Init();
     Interrupt::Init();
     System::sys_instance = this;
 }
@@ -79,16 +91,19 @@ System::~System()
 void System::Reset()
 {
     SYS_INFO("Reseting all system modules");
+    // devices schedule their events again on reset
+    Scheduler::Reset();
     Bios::Reset();
     Cop0::Reset();
     Cpu::Reset();
+    // the gpu drives the timers, so they come first
+    Timer::Reset();
     Gpu::Reset();
     Ram::Reset();
     Dma::Reset();
     Scratchpad::Reset();
     MemControl::Reset();
     Bus::Reset();
-    Timer::Reset();
     Interrupt::Reset();
     if (!System::sys_instance->m_headless_mode) {
         View::Clear();
@@ -105,44 +120,79 @@ void System::Run()
         throw std::runtime_error("Cannot Run() while in headless mode, use Step() instead");
     }
 
-    // DEBUG
-    g_emu_state.paused = true;
+    // DEBUG, batch runs in turbo start right away
+    g_emu_state.paused = !g_emu_state.turbo;
     // using namespace Psx::ImGuiLayer::DbgMod;
     // <declare breakpoints here>
 
+    using namespace std::chrono;
     bool should_close = false;
-    long long delta_ns = 0;
     int fps = 0;
-    const long long frame_time_ns = (1.0 / 60.0) * 1'000'000'000; // nano seconds in 1 frame for 60 fps
+    u64 frames = 0;
     u64 clocks = 0;
-    SYS_INFO("Target Frame Time: {} ns", frame_time_ns);
+    // frames run since starting, picks which ones turbo rasterizes
+    u64 frame_num = 0;
+    // the last frame run was rasterized
+    bool drawn = true;
+    // when the frame being run should be shown
+    steady_clock::time_point vsync = steady_clock::now();
     while (!should_close) {
         // display current cpu emulation speed
         if (Util::OneSecPassed()) {
-            View::SetTitleExtra(PSX_FMT(" -- CPU: {:.4f} MHz ({:.1f}%) -- FPS: {}",
-                (double)clocks / 1'000'000, (double)clocks / 33'868'8/*00*/, fps));
+            // as a multiple of real time
+            double speed = static_cast<double>(clocks) / CPU_MAX_CLOCK_RATE;
+            View::SetTitleExtra(PSX_FMT(" -- CPU: {:.4f} MHz ({:.2f}x) -- FPS: {}",
+                static_cast<double>(clocks) / 1'000'000, speed, fps));
+            if (g_emu_state.turbo) {
+                std::cout << PSX_FMT("Speed: {:.2f}x real time ({} frames/s)\n", speed, frames);
+            }
             clocks = 0;
             fps = 0;
+            frames = 0;
         }
 
-        // gui update
-        View::OnUpdate();
-        fps++;
+        // only turbo skips frames, everything else draws them all
+        if (!g_emu_state.turbo || g_emu_state.paused) {
+            View::SetDrawEnabled(true);
+            drawn = true;
+        }
+
+        // gui update, turbo only shows the frames it rasterized
+        if (drawn) {
+            View::OnUpdate();
+            fps++;
+        }
 
         // system step
         if (g_emu_state.step_count > 0) {
             Step();
             g_emu_state.step_count--;
-        } else {
-            while (!g_emu_state.paused && delta_ns < frame_time_ns && clocks <= CPU_MAX_CLOCK_RATE) {
-                Step();
-                clocks++;
-                delta_ns += Util::GetDeltaTime();
+        } else if (!g_emu_state.paused) {
+            frames++;
+            // turbo rasterizes (and shows) every frame_skip'th frame
+            u32 frame_skip = std::max(g_emu_state.frame_skip, 1u);
+            drawn = !g_emu_state.turbo || frame_num % frame_skip == 0;
+            View::SetDrawEnabled(drawn);
+            frame_num++;
+            u32 frame_clocks = RunFrame();
+            clocks += frame_clocks;
+            // pace by the guest time the frame took, about 1/60 (or 1/50) of
+            // a second at 1x
+            auto frame_time = duration_cast<steady_clock::duration>(duration<double>(
+                frame_clocks / (CPU_MAX_CLOCK_RATE * static_cast<double>(g_emu_state.speed))));
+            vsync += frame_time;
+            auto now = steady_clock::now();
+            if (g_emu_state.turbo || now > vsync + frame_time) {
+                // unthrottled, or too far behind to catch up, pace from
+                // here instead
+                vsync = now;
             }
+            Util::SleepUntil(vsync);
+        } else {
+            vsync = steady_clock::now();
         }
 
         // reset some state
-        delta_ns = 0;
         if (!g_emu_state.paused) {
             g_emu_state.step_count = 0;
         }
@@ -150,19 +200,15 @@ void System::Run()
     }
 }
 
-bool System::Step()
+/*
+ * Step the system. Returns the number of cpu cycles that passed, which can be
+ * more than one when the cpu runs recompiled blocks.
+ */
+u32 System::Step()
 {
     using namespace Psx::View::ImGuiLayer::DbgMod;
-    // Some timing notes:
-    // Scanline:
-    //  CPU Cycles = 2172
-    //  GPU Cylces = 3413
-    // Frame:
-    //  CPU Cycles = 2172 * 263
-    //  GPU Cycles = 3413 * 263
-
     // CPU
-    Cpu::Step();
+    u32 cycles = Cpu::Step();
 #ifdef PSX_DEBUG
     // check breakpoints
     Breakpoints::Saw<Breakpoints::BrkType::PCWatch>(Cpu::GetPC());
@@ -171,18 +217,40 @@ bool System::Step()
     }
 #endif
 
-    // GPU
-    bool time_to_render = Gpu::Step();
-    
-    // DMA
-    Dma::Step();
+    Scheduler::Advance(cycles);
+    return cycles;
+}
 
-    // timers
-    Timer::Step();
+/*
+ * Run until the gpu starts the next frame, about 33868800/60 cycles for NTSC
+ * or /50 for PAL. Returns the number of cycles that passed.
+ */
+u32 System::RunFrame()
+{
+    return RunCycles(Gpu::CyclesToNextFrame());
+}
 
-    // interrupt controller
-    Interrupt::Step();
-    return true;
+/*
+ * Run the system for about the given number of cycles. The cpu runs up to
+ * the next scheduled event, then the event fires and the cpu carries on.
+ * Returns the number of cycles that passed.
+ */
+u32 System::RunCycles(u32 cycles)
+{
+    using namespace Psx::View::ImGuiLayer::DbgMod;
+    u32 ran = 0;
+    while (ran < cycles) {
+        u32 batch = Cpu::Run(Scheduler::NextSlice(cycles - ran));
+        Scheduler::Advance(batch);
+        ran += batch;
+#ifdef PSX_DEBUG
+        if (Breakpoints::ReadyToBreak()) {
+            View::OnUpdate();
+            break;
+        }
+#endif
+    }
+    return ran;
 }
 
 }// end namespace
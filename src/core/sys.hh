@@ -23,7 +23,9 @@ public:
     System(const std::string& bios_path, bool headless_mode);
     ~System();
     void Run();
-    bool Step();
+    u32 Step();
+    u32 RunCycles(u32 cycles);
+    u32 RunFrame();
     static void Reset();
 
 private:
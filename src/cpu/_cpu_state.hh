@@ -0,0 +1,46 @@
+/*
+ * _cpu_state.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * CPU register and delay slot state. Shared between the interpreter and the
+ * recompiler, nothing outside of src/cpu should include this.
+ */
+
+#pragma once
+
+#include "util/psxutil.hh"
+#include "cpu/blockcache.hh"
+
+namespace Psx {
+namespace Cpu {
+
+struct Registers {
+    // special
+    u32 pc = 0xbfc0'0000; // beginning of BIOS
+    u32 hi = 0;
+    u32 lo = 0;
+    // general purpose
+    u32 r[32] = {0};
+};
+
+struct LoadDelaySlot {
+    u8  reg = 0;
+    u32 val = 0;
+    bool is_primed = false;  // current instruction is a load
+    bool was_primed = false; // prev instruction was a load
+};
+
+struct BranchDelaySlot {
+    bool is_primed = false;
+    bool was_primed = false;
+    bool take_branch = false;
+    u32 pc = 0; // the pc to load after executing delay
+};
+
+// Run one decoded instruction, handling the load and branch delay slots.
+void StepInstr(BlockCache::OpFunc fn, const Asm::Instruction& instr);
+
+}// end namespace
+}
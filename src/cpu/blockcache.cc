@@ -0,0 +1,242 @@
+/*
+ * blockcache.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Cache of pre-decoded basic blocks for the cached interpreter. Blocks are
+ * keyed by the virtual address of their first instruction. Blocks living in
+ * RAM are tracked per 4KB page so that any write to a page holding code drops
+ * the stale blocks.
+ */
+
+#include "cpu/blockcache.hh"
+#include "mem/fastmem.hh"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+#define BC_INFO(...) PSXLOG_INFO("Block-Cache", __VA_ARGS__)
+#define BC_WARN(...) PSXLOG_WARN("Block-Cache", __VA_ARGS__)
+#define BC_ERROR(...) PSXLOG_ERROR("Block-Cache", __VA_ARGS__)
+
+constexpr u32 RamSize = 2 * 1024 * 1024;
+constexpr u32 RamPageSize = 4 * 1024;
+constexpr u32 NumRamPages = RamSize / RamPageSize;
+
+// *** Private Data and Helpers ***
+namespace  {
+struct State {
+    std::unordered_map<u32, std::unique_ptr<Psx::Cpu::BlockCache::Block>> blocks;
+    // start pcs of all blocks that have code in each page of RAM
+    std::vector<u32> ram_pages[NumRamPages];
+    u64 generation = 0;
+    u64 invalidations = 0;
+    // pages with code are write protected in fastmem (see SetProtectCode)
+    bool protect_code = false;
+} s;
+
+/*
+ * Returns true if the address falls in one of the segments (kuseg, kseg0, kseg1)
+ * that map the physical address space directly.
+ */
+inline bool inDirectSegment(u32 addr)
+{
+    u32 seg = addr >> 29;
+    return seg == 0 || seg == 4 || seg == 5;
+}
+
+inline bool inRam(u32 addr)
+{
+    return inDirectSegment(addr) && (addr & 0x1fff'ffff) < 0x0080'0000;
+}
+
+inline bool inBios(u32 addr)
+{
+    return inDirectSegment(addr) && (addr & 0x1fff'ffff) - 0x1fc0'0000 < 512 * 1024;
+}
+
+inline u32 ramPage(u32 addr)
+{
+    return (addr & (RamSize - 1)) / RamPageSize;
+}
+
+/*
+ * Remove a block's pc from every page it has code in, a block can span two.
+ * Pages left without code don't need their stores checked anymore.
+ */
+void unlinkPages(const Psx::Cpu::BlockCache::Block& block)
+{
+    u32 prev_page = NumRamPages;
+    for (u32 i = 0; i < block.instrs.size(); i++) {
+        u32 page_num = ramPage(block.pc + i * 4);
+        if (page_num == prev_page) {
+            continue;
+        }
+        prev_page = page_num;
+        auto& page = s.ram_pages[page_num];
+        auto iter = std::find(page.begin(), page.end(), block.pc);
+        if (iter != page.end()) {
+            page.erase(iter);
+            if (page.empty()) {
+                Psx::Fastmem::UnprotectCode(page_num);
+            }
+        }
+    }
+}
+}// end namespace
+
+namespace Psx {
+namespace Cpu {
+namespace BlockCache {
+
+void Init()
+{
+    BC_INFO("Initializing Block Cache");
+    Reset();
+}
+
+void Reset()
+{
+    BC_INFO("Resetting state");
+    Clear();
+    s.invalidations = 0;
+}
+
+/*
+ * Returns true if code at the given address can be pre-decoded and cached.
+ * Only RAM and BIOS are supported, everything else should be interpreted.
+ */
+bool IsCacheable(u32 pc)
+{
+    return inRam(pc) || inBios(pc);
+}
+
+/*
+ * Find the block that starts at pc. Returns nullptr on a miss.
+ */
+Block* Lookup(u32 pc)
+{
+    auto iter = s.blocks.find(pc);
+    return iter == s.blocks.end() ? nullptr : iter->second.get();
+}
+
+/*
+ * Add a freshly decoded block to the cache, replacing any old block at the
+ * same address.
+ */
+Block* Insert(Block&& block)
+{
+    PSX_ASSERT(IsCacheable(block.pc) && !block.instrs.empty());
+    u32 pc = block.pc;
+    auto& entry = s.blocks[pc];
+    if (entry != nullptr && inRam(pc)) {
+        unlinkPages(*entry);
+    }
+    if (inRam(pc)) {
+        // mark every page this block has code in
+        for (u32 i = 0; i < block.instrs.size(); i++) {
+            u32 page_num = ramPage(pc + i * 4);
+            auto& page = s.ram_pages[page_num];
+            if (page.empty() && s.protect_code) {
+                // stores from recompiled code need to come through here
+                Fastmem::ProtectCode(page_num);
+            }
+            if (std::find(page.begin(), page.end(), pc) == page.end()) {
+                page.push_back(pc);
+            }
+        }
+    }
+    entry = std::make_unique<Block>(std::move(block));
+    return entry.get();
+}
+
+/*
+ * Should be called on every write to RAM. Drops all blocks that have code in
+ * the same page as the written address, along with their place in any other
+ * page they span.
+ */
+void InvalidateRam(u32 addr)
+{
+    u32 page_num = ramPage(addr);
+    if (s.ram_pages[page_num].empty()) {
+        return;
+    }
+
+    // unlinking edits the page's list
+    std::vector<u32> pcs = std::move(s.ram_pages[page_num]);
+    s.ram_pages[page_num].clear();
+    for (u32 pc : pcs) {
+        auto iter = s.blocks.find(pc);
+        if (iter != s.blocks.end()) {
+            unlinkPages(*iter->second);
+            s.blocks.erase(iter);
+        }
+    }
+    Fastmem::UnprotectCode(page_num);
+    s.generation++;
+    s.invalidations++;
+}
+
+/*
+ * Only recompiled code stores straight to host memory, so the pages holding
+ * code only need protecting while it can run. Catches up on the pages that
+ * already have code when turned on.
+ */
+void SetProtectCode(bool protect)
+{
+    if (protect == s.protect_code) {
+        return;
+    }
+    s.protect_code = protect;
+    if (!protect) {
+        Fastmem::UnprotectAllCode();
+        return;
+    }
+    for (u32 page_num = 0; page_num < NumRamPages; page_num++) {
+        if (!s.ram_pages[page_num].empty()) {
+            Fastmem::ProtectCode(page_num);
+        }
+    }
+}
+
+/*
+ * Drop every block in the cache.
+ */
+void Clear()
+{
+    s.blocks.clear();
+    for (auto& page : s.ram_pages) {
+        page.clear();
+    }
+    Fastmem::UnprotectAllCode();
+    s.generation++;
+}
+
+u64 Generation()
+{
+    return s.generation;
+}
+
+/*
+ * Address of the generation counter, so recompiled code can check it.
+ */
+const u64* GenerationPtr()
+{
+    return &s.generation;
+}
+
+size_t NumBlocks()
+{
+    return s.blocks.size();
+}
+
+u64 NumInvalidations()
+{
+    return s.invalidations;
+}
+
+}// end namespace
+}
+}
@@ -0,0 +1,80 @@
+/*
+ * blockcache.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Cache of pre-decoded basic blocks for the cached interpreter.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "util/psxutil.hh"
+#include "cpu/asm/asm.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace BlockCache {
+
+using OpFunc = u8 (*)(const Asm::Instruction&);
+
+struct CachedInstr;
+
+// Runs a pair of instructions as one operation, returns the number of
+// instructions executed.
+using FusedFunc = u32 (*)(const CachedInstr& first, const CachedInstr& second);
+
+// A single instruction that has already been decoded and had its handler
+// resolved.
+struct CachedInstr {
+    OpFunc fn;
+    Asm::Instruction instr;
+    // set on the first instruction of a fused pair (superinstruction)
+    FusedFunc fused = nullptr;
+    // nothing can be pending in either delay slot when this instruction runs
+    bool no_delay = false;
+    // load whose register isn't used by the next instruction, so the value
+    // can be written right away instead of going through the load delay slot
+    bool commit_load = false;
+};
+
+// A run of instructions starting at pc and ending after the delay slot of the
+// first branch/jump (or when the block hits its max length).
+struct Block {
+    u32 pc;
+    std::vector<CachedInstr> instrs;
+    // host code from the recompiler, only valid while jit_epoch matches
+    u32 (*jit_fn)() = nullptr;
+    u32 jit_epoch = 0;
+    // branches back to its own start and only touches registers (busy wait)
+    bool idle_loop = false;
+    // times the block was entered, used to decide when to recompile it
+    u32 exec_count = 0;
+};
+
+constexpr u32 MaxBlockLen = 128;
+
+void Init();
+void Reset();
+
+bool IsCacheable(u32 pc);
+Block* Lookup(u32 pc);
+Block* Insert(Block&& block);
+void InvalidateRam(u32 addr);
+void SetProtectCode(bool protect);
+void Clear();
+
+// generation changes every time a block is dropped from the cache, so any
+// outstanding Block pointers can be checked for staleness cheaply.
+u64 Generation();
+const u64* GenerationPtr();
+
+// stats
+size_t NumBlocks();
+u64 NumInvalidations();
+
+}// end namespace
+}
+}
@@ -15,6 +15,8 @@
 
 #include "util/psxutil.hh"
 #include "cpu/cpu.hh"
+#include "cpu/interrupt.hh"
+#include "mem/bus.hh"
 
 #include "imgui/imgui.h"
 
@@ -127,6 +129,12 @@ struct State {
                 raw |= (val & 0x3) << 8;
             }
 
+            void SetHWIntPending(bool pending)
+            {
+                raw &= ~(0x1u << 10);
+                raw |= static_cast<u32>(pending) << 10;
+            }
+
             void SetCopNum(u32 cop_num)
             {
                 raw &= ~(0x3u << 28);
@@ -193,6 +201,7 @@ void Reset()
 {
     COP0_INFO("Resetting state");
     s.regs = {};
+    Bus::SetCacheIsolated(false);
 }
 
 /*
@@ -209,6 +218,12 @@ void RaiseException(const Exception& ex)
     // update badv
     s.regs.badv = ex.badv;
 
+    // push the interrupt enable/kernel mode stack, entering the handler with
+    // interrupts off
+    u32 ie_ku = s.regs.sr.raw & 0x3f;
+    s.regs.sr.raw &= ~(0x3fu);
+    s.regs.sr.raw |= (ie_ku << 2) & 0x3f;
+
     // update epc
     s.regs.epc = Cpu::GetPC() + 4; // pc has already incremented
     if (s.regs.cause.GetExType() != Exception::Type::Interrupt && s.regs.cause.GetBD()) {
@@ -244,6 +259,8 @@ void ExeCmd(u32 command)
         u32 bits_4_5 = (s.regs.sr.raw >> 4) & 0x3;
         s.regs.sr.raw &= ~(0xfu);
         s.regs.sr.raw |= bits_2_3 | (bits_4_5 << 2);
+        // interrupts may be enabled again
+        Interrupt::Recheck();
     } else {
         COP0_WARN("Command not supported: 0x{:08x}", command);
         // raise exception
@@ -315,7 +332,10 @@ void Mt(u32 data, u8 reg)
     case  8: /*BADV Read Only*/       break;
     case  9: s.regs.bdam      = data; break;
     case 11: s.regs.bpcm      = data; break;
-    case 12: s.regs.sr.raw    = data; break;
+    case 12:
+        s.regs.sr.raw = data;
+        Bus::SetCacheIsolated(CacheIsIsolated());
+        break;
     case 13: s.regs.cause.SetSWIntPending((data >> 8) & 0x3); break; // only bits 8-9 are writable
     case 14: /*EPC Read Only*/        break;
     case 15: /*PRID Read Only*/       break;
@@ -346,6 +366,11 @@ void Mt(u32 data, u8 reg)
         RaiseException(e);
         break;
     }
+
+    // interrupt enables or software interrupts may have changed
+    if (reg == 12 || reg == 13) {
+        Interrupt::Recheck();
+    }
 }
 
 void OnActive(bool *active)
@@ -404,6 +429,26 @@ bool CacheIsIsolated()
     return (s.regs.sr.raw >> 16) & 0x1;
 }
 
+/*
+ * Hardware interrupt line (IP2) from the interrupt controller, set while any
+ * unmasked interrupt is pending.
+ */
+void SetHWIntPending(bool pending)
+{
+    s.regs.cause.SetHWIntPending(pending);
+}
+
+/*
+ * Returns true if the cpu should take an interrupt: interrupts are enabled
+ * (SR.IEc) and a pending one in CAUSE isn't masked by SR.IM.
+ */
+bool InterruptPending()
+{
+    u32 pending = (s.regs.cause.raw >> 8) & 0xff;
+    u32 mask = (s.regs.sr.raw >> 8) & 0xff;
+    return (s.regs.sr.raw & 0x1) && (pending & mask) != 0;
+}
+
 
 }// end namespace
 }
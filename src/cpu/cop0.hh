@@ -41,6 +41,8 @@ void ExeCmd(u32 command);
 u32 Mf(u8 reg);
 void Mt(u32 data, u8 reg);
 bool CacheIsIsolated();
+void SetHWIntPending(bool pending);
+bool InterruptPending();
 
 }// end namespace
 }
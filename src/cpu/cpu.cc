@@ -7,11 +7,21 @@
  * CPU for the PSX. The Playstation uses a R3000A MIPS processor.
  */
 
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
 #include "imgui/imgui.h"
 
 #include "cpu/cpu.hh"
 #include "cpu/cop0.hh"
+#include "cpu/blockcache.hh"
+#include "cpu/icache.hh"
+#include "cpu/_cpu_state.hh"
+#include "cpu/jit/jit.hh"
+#include "cpu/transcache.hh"
 #include "mem/bus.hh"
+#include "mem/fastmem.hh"
 #include "core/globals.hh"
 #include "view/imgui/dbgmod.hh"
 
@@ -24,40 +34,235 @@ using opfunc = u8 (*)(const Psx::Cpu::Asm::Instruction&);
 // *** Private Data and Helpers ***
 namespace  {
 // Protos
-void buildOpMaps();
+opfunc resolveOp(const Psx::Cpu::Asm::Instruction& instr);
+u32 interpret(u32 count);
+u32 stepCached();
+u32 stepRecompiled();
+u32 stepTiered();
+u32 stepCold();
+void resetTiers();
+bool isIdleLoop(const Psx::Cpu::BlockCache::Block& block);
+bool checkIdleLoop(const Psx::Cpu::BlockCache::Block *block);
+void fuseBlock(Psx::Cpu::BlockCache::Block& block);
+void analyzeDelaySlots(Psx::Cpu::BlockCache::Block& block);
+const char* execModeName(Psx::Cpu::ExecMode mode);
 using namespace Psx::Cpu;
 
+// Flat dispatch table: 64 primary ops, 64 secondary ops, 32 bcondz ops
+constexpr u32 SecondaryBase = 0x40;
+constexpr u32 BcondzBase = 0x80;
+constexpr u32 DispatchSize = 0xa0;
+
+/*
+ * Build the flat dispatch table at compile time. Secondary (Special) ops live
+ * after the primary ops indexed by funct, and the Bcondz ops after those
+ * indexed by the rt field, so every handler is a single lookup away.
+ */
+constexpr std::array<opfunc, DispatchSize> makeDispatchTable()
+{
+    std::array<opfunc, DispatchSize> t{};
+    for (auto& fn : t) {
+        fn = BadOp;
+    }
+
+    // Primary Op Encoding
+    t[0x00] = Special;     t[0x01] = Bcondz;
+    t[0x02] = J;           t[0x03] = Jal;
+    t[0x04] = Beq;         t[0x05] = Bne;
+    t[0x06] = Blez;        t[0x07] = Bgtz;
+    t[0x08] = Addi;        t[0x09] = Addiu;
+    t[0x0a] = Slti;        t[0x0b] = Sltiu;
+    t[0x0c] = Andi;        t[0x0d] = Ori;
+    t[0x0e] = Xori;        t[0x0f] = Lui;
+
+    t[0x10] = Cop0;        t[0x11] = Cop1;
+    t[0x12] = Cop2;        t[0x13] = Cop3;
+    t[0x14] = BadOp;       t[0x15] = BadOp;
+    t[0x16] = BadOp;       t[0x17] = BadOp;
+    t[0x18] = BadOp;       t[0x19] = BadOp;
+    t[0x1a] = BadOp;       t[0x1b] = BadOp;
+    t[0x1c] = BadOp;       t[0x1d] = BadOp;
+    t[0x1e] = BadOp;       t[0x1f] = BadOp;
+
+    t[0x20] = Lb;          t[0x21] = Lh;
+    t[0x22] = Lwl;         t[0x23] = Lw;
+    t[0x24] = Lbu;         t[0x25] = Lhu;
+    t[0x26] = Lwr;         t[0x27] = BadOp;
+    t[0x28] = Sb;          t[0x29] = Sh;
+    t[0x2a] = Swl;         t[0x2b] = Sw;
+    t[0x2c] = BadOp;       t[0x2d] = BadOp;
+    t[0x2e] = Swr;         t[0x2f] = BadOp;
+
+    t[0x30] = LwC0;        t[0x31] = LwC1;
+    t[0x32] = LwC2;        t[0x33] = LwC3;
+    t[0x34] = BadOp;       t[0x35] = BadOp;
+    t[0x36] = BadOp;       t[0x37] = BadOp;
+    t[0x38] = SwC0;        t[0x39] = SwC1;
+    t[0x3a] = SwC2;        t[0x3b] = SwC3;
+    t[0x3c] = BadOp;       t[0x3d] = BadOp;
+    t[0x3e] = BadOp;       t[0x3f] = BadOp;
+
+    // Secondary Op Encoding
+    t[SecondaryBase + 0x00] = Sll;       t[SecondaryBase + 0x01] = BadOp;
+    t[SecondaryBase + 0x02] = Srl;       t[SecondaryBase + 0x03] = Sra;
+    t[SecondaryBase + 0x04] = Sllv;      t[SecondaryBase + 0x05] = BadOp;
+    t[SecondaryBase + 0x06] = Srlv;      t[SecondaryBase + 0x07] = Srav;
+    t[SecondaryBase + 0x08] = Jr;        t[SecondaryBase + 0x09] = Jalr;
+    t[SecondaryBase + 0x0a] = BadOp;     t[SecondaryBase + 0x0b] = BadOp;
+    t[SecondaryBase + 0x0c] = Syscall;   t[SecondaryBase + 0x0d] = Break;
+    t[SecondaryBase + 0x0e] = BadOp;     t[SecondaryBase + 0x0f] = BadOp;
+
+    t[SecondaryBase + 0x10] = Mfhi;      t[SecondaryBase + 0x11] = Mthi;
+    t[SecondaryBase + 0x12] = Mflo;      t[SecondaryBase + 0x13] = Mtlo;
+    t[SecondaryBase + 0x14] = BadOp;     t[SecondaryBase + 0x15] = BadOp;
+    t[SecondaryBase + 0x16] = BadOp;     t[SecondaryBase + 0x17] = BadOp;
+    t[SecondaryBase + 0x18] = Mult;      t[SecondaryBase + 0x19] = Multu;
+    t[SecondaryBase + 0x1a] = Div;       t[SecondaryBase + 0x1b] = Divu;
+    t[SecondaryBase + 0x1c] = BadOp;     t[SecondaryBase + 0x1d] = BadOp;
+    t[SecondaryBase + 0x1e] = BadOp;     t[SecondaryBase + 0x1f] = BadOp;
+
+    t[SecondaryBase + 0x20] = Add;       t[SecondaryBase + 0x21] = Addu;
+    t[SecondaryBase + 0x22] = Sub;       t[SecondaryBase + 0x23] = Subu;
+    t[SecondaryBase + 0x24] = And;       t[SecondaryBase + 0x25] = Or;
+    t[SecondaryBase + 0x26] = Xor;       t[SecondaryBase + 0x27] = Nor;
+    t[SecondaryBase + 0x28] = BadOp;     t[SecondaryBase + 0x29] = BadOp;
+    t[SecondaryBase + 0x2a] = Slt;       t[SecondaryBase + 0x2b] = Sltu;
+    t[SecondaryBase + 0x2c] = BadOp;     t[SecondaryBase + 0x2d] = BadOp;
+    t[SecondaryBase + 0x2e] = BadOp;     t[SecondaryBase + 0x2f] = BadOp;
+
+    t[SecondaryBase + 0x30] = BadOp;     t[SecondaryBase + 0x31] = BadOp;
+    t[SecondaryBase + 0x32] = BadOp;     t[SecondaryBase + 0x33] = BadOp;
+    t[SecondaryBase + 0x34] = BadOp;     t[SecondaryBase + 0x35] = BadOp;
+    t[SecondaryBase + 0x36] = BadOp;     t[SecondaryBase + 0x37] = BadOp;
+    t[SecondaryBase + 0x38] = BadOp;     t[SecondaryBase + 0x39] = BadOp;
+    t[SecondaryBase + 0x3a] = BadOp;     t[SecondaryBase + 0x3b] = BadOp;
+    t[SecondaryBase + 0x3c] = BadOp;     t[SecondaryBase + 0x3d] = BadOp;
+    t[SecondaryBase + 0x3e] = BadOp;     t[SecondaryBase + 0x3f] = BadOp;
+
+    // Bcondz Op encoding
+    t[BcondzBase + 0x00] = Bltz;
+    t[BcondzBase + 0x01] = Bgez;
+    t[BcondzBase + 0x10] = Bltzal;
+    t[BcondzBase + 0x11] = Bgezal;
+    return t;
+}
+
+constexpr std::array<opfunc, DispatchSize> DispatchTable = makeDispatchTable();
+
+/*
+ * Index of the instruction's handler in the dispatch table.
+ */
+inline u32 dispatchIndex(const Psx::Cpu::Asm::Instruction& instr)
+{
+    switch (instr.op) {
+    case 0x00: return SecondaryBase + instr.funct;
+    case 0x01: return BcondzBase + instr.bcondz_op;
+    default: return instr.op;
+    }
+}
+
 // State
 struct State {
-    // op maps
-    opfunc prim_opmap[0x40] = {0};
-    opfunc sec_opmap[0x40] = {0};
-    std::map<u8, opfunc> bcondz_opmap;
-
     // registers
-    struct Registers {
-        // special
-        u32 pc = 0xbfc0'0000; // beginning of BIOS
-        u32 hi = 0;
-        u32 lo = 0;
-        // general purpose
-        u32 r[32] = {0};
-    } regs;
+    Registers regs;
     // load delay slot
-    struct LoadDelaySlot {
-        u8  reg = 0;
-        u32 val = 0;
-        bool is_primed = false;  // current instruction is a load
-        bool was_primed = false; // prev instruction was a load
-    } lds;
+    LoadDelaySlot lds;
     // branch delay slot
-    struct BranchDelaySlot {
-        bool is_primed = false;
-        bool was_primed = false;
-        bool take_branch = false;
-        u32 pc; // the pc to load after executing delay
-    } bds;
+    BranchDelaySlot bds;
+
+    ExecMode exec_mode = ExecMode::Interpreter;
+    // set when the current Run() batch should end early
+    bool exit_requested = false;
+
+    // set while inside Run(), idle loop detection and instruction fusion
+    // only happen there so Step() keeps going one instruction at a time
+    bool in_run = false;
+    // cycles run so far by the current Run(), see CyclesThisRun
+    u32 run_cycles = 0;
+
+    // idle loop detection (see checkIdleLoop)
+    bool idle_hit = false;
+    struct IdleLoop {
+        bool armed = false;
+        u32 pc = 0;
+        Registers regs;
+        LoadDelaySlot lds;
+    } idle;
+    u64 idle_cycles_skipped = 0;
+
+    // superinstruction stats
+    u64 cached_instrs = 0;
+    u64 fused_pairs = 0;
+
+    // tiered execution (see stepTiered)
+    struct Tiers {
+        // entries before a block gets cached (warm) or recompiled (hot)
+        u32 warm_threshold = 16;
+        u32 hot_threshold = 1024;
+        // entry counts of blocks that are still interpreted
+        std::unordered_map<u32, u32> profile;
+        // interpreting a block that isn't warm yet
+        bool in_cold_block = false;
+        // instructions run in each tier
+        u64 cold_instrs = 0;
+        u64 warm_instrs = 0;
+        u64 hot_instrs = 0;
+        u64 warm_promotions = 0;
+        u64 hot_promotions = 0;
+    } tiers;
+    // position in the block currently run by the cached interpreter
+    struct BlockCursor {
+        BlockCache::Block *block = nullptr;
+        u32 index = 0;
+        u32 pc = 0; // pc expected by the next instruction in the block
+        u64 generation = 0;
+    } cursor;
 } s;
+
+// Bookkeeping done around every instruction, see StepInstr.
+struct InstrContext {
+    bool take_branch;
+    u32 baddr;
+    u32 old_lds_val;
+    u8 old_lds_reg;
+};
+
+inline InstrContext beginInstr()
+{
+    InstrContext ctx;
+    // check if last instruction was a branch/jump
+    s.bds.was_primed = s.bds.is_primed;
+    s.bds.is_primed = false;
+    ctx.take_branch = s.bds.take_branch;
+    s.bds.take_branch = false;
+    ctx.baddr = s.bds.pc;
+
+    // if previous instruction was a load, the load delay will be primed.
+    // we need to check this here just in case the next instruction will
+    // re-prime the load delay slot.
+    ctx.old_lds_val = s.lds.val;
+    ctx.old_lds_reg = s.lds.reg;
+    s.lds.was_primed = s.lds.is_primed;
+    s.lds.is_primed = false;
+
+    s.regs.pc += 4;
+    return ctx;
+}
+
+inline void endInstr(const InstrContext& ctx, u8 modified_reg)
+{
+    // update pc (dependent on branch)
+    s.regs.pc = ctx.take_branch ? ctx.baddr : s.regs.pc;
+
+    // race condition: if instruction writes to same register in load
+    // delay slot, the instruction wins over the load.
+    if (s.lds.was_primed && modified_reg != s.lds.reg) {
+        s.regs.r[ctx.old_lds_reg] = ctx.old_lds_val;
+    }
+
+    // zero register should always be zero
+    s.regs.r[0] = 0;
+}
 }// namespace
 
 namespace Psx {
@@ -69,7 +274,9 @@ namespace Cpu {
 void Init()
 {
     CPU_INFO("Initializing CPU");
-    buildOpMaps();
+    ICache::Init();
+    BlockCache::Init();
+    Jit::Init(&s.regs, &s.lds, &s.bds);
     Reset();
 }
 
@@ -84,52 +291,141 @@ void Reset()
     s.bds = {};
     // registers
     s.regs = {};
+    ICache::Reset();
+    // pre-decoded blocks
+    BlockCache::Reset();
+    Jit::Reset();
+    s.cursor = {};
+    s.idle = {};
+    s.idle_cycles_skipped = 0;
+    s.cached_instrs = 0;
+    s.fused_pairs = 0;
+    resetTiers();
 }
 
 /*
- * Execute one instruction. On average, takes 1 psx clock cycle.
+ * Execute one instruction (or a whole block when recompiling). On average,
+ * each instruction takes 1 psx clock cycle. Returns the number of cycles run.
  */
-void Step()
+u32 Step()
 {
-    // fetch next instruction
-    // TODO: Right now, we ignore instruction cache. This shouldn't be
-    // a problem for most games, but maybe something to come back to in
-    // the future.
-    u32 cur_instr = Bus::Read<u32>(s.regs.pc);
+    if (s.exec_mode == ExecMode::Recompiler) {
+        return stepRecompiled();
+    }
+    if (s.exec_mode == ExecMode::CachedInterpreter) {
+        return stepCached();
+    }
+    if (s.exec_mode == ExecMode::Tiered) {
+        return stepTiered();
+    }
 
-    // check if last instruction was a branch/jump
-    s.bds.was_primed = s.bds.is_primed;
-    s.bds.is_primed = false;
-    bool take_branch = s.bds.take_branch;
-    s.bds.take_branch = false;
-    u32 baddr = s.bds.pc;
+    interpret(1);
+    return 1;
+}
 
-    // if previous instruction was a load, the load delay will be primed.
-    // we need to check this here just in case the next instruction will
-    // re-prime the load delay slot.
-    u32 old_lds_val = s.lds.val;
-    u8 old_lds_reg = s.lds.reg;
-    s.lds.was_primed = s.lds.is_primed;
-    s.lds.is_primed = false;
+/*
+ * Run instructions until about the given number of cycles have passed or
+ * something asks the cpu to stop (see RequestExit). Returns the number of
+ * cycles actually run, which can go a little over budget when running
+ * recompiled blocks.
+ *
+ * When not interpreting, busy wait loops are detected and the rest of the
+ * budget is skipped since nothing the loop polls can change before the next
+ * scheduled event.
+ */
+u32 Run(u32 cycles)
+{
+    using namespace Psx::View::ImGuiLayer::DbgMod;
+    s.exit_requested = false;
+    s.in_run = true;
+    s.idle.armed = false;
+    s.run_cycles = 0;
+    u32 ran = 0;
+    while (ran < cycles && !s.exit_requested) {
+        if (s.exec_mode == ExecMode::Interpreter) {
+            // checks pc breakpoints itself
+            ran += interpret(cycles - ran);
+        } else {
+            ran += Step();
+#ifdef PSX_DEBUG
+            Breakpoints::Saw<Breakpoints::BrkType::PCWatch>(s.regs.pc);
+#endif
+        }
+#ifdef PSX_DEBUG
+        if (Breakpoints::ReadyToBreak()) {
+            break;
+        }
+#endif
+        if (s.idle_hit) {
+            s.idle_hit = false;
+            s.idle_cycles_skipped += cycles - ran;
+            ran = cycles;
+        }
+        s.run_cycles = ran;
+    }
+    s.in_run = false;
+    return ran;
+}
 
-    // execute
-    s.regs.pc += 4;
-    u8 modified_reg = ExecuteInstruction(cur_instr);
+/*
+ * Cycles run so far by the Run() in progress (0 outside of one), so the rest
+ * of the hardware can tell the exact time in the middle of a batch. Counts
+ * every instruction when interpreting and every block otherwise.
+ */
+u32 CyclesThisRun()
+{
+    return s.in_run ? s.run_cycles : 0;
+}
 
-    // update pc (dependent on branch)
-    s.regs.pc = take_branch ? baddr : s.regs.pc;
+/*
+ * End the current Run() batch after the instruction (or block) that is
+ * running. Used by hardware that needs to react to a cpu write right away.
+ */
+void RequestExit()
+{
+    s.exit_requested = true;
+}
 
-    // race condition: if instruction writes to same register in load
-    // delay slot, the instruction wins over the load.
-    if (s.lds.was_primed && modified_reg != s.lds.reg) {
-        s.regs.r[old_lds_reg] = old_lds_val;
-    }
+/*
+ * Called by hardware whose registers change without a scheduled event (like
+ * the timer values), so a loop polling them never counts as idle.
+ */
+void BreakIdleLoop()
+{
+    s.idle.armed = false;
+}
 
-    // zero register should always be zero
-    s.regs.r[0] = 0;
+/*
+ * Total number of cycles skipped by idle loop detection.
+ */
+u64 IdleCyclesSkipped()
+{
+    return s.idle_cycles_skipped;
 }
 
+/*
+ * Number of instruction pairs the cached interpreter ran as a single fused
+ * operation, and the total number of instructions it ran.
+ */
+u64 NumFusedPairs()
+{
+    return s.fused_pairs;
+}
 
+u64 NumCachedInstrs()
+{
+    return s.cached_instrs;
+}
+
+/*
+ * Run one decoded instruction, handling the load and branch delay slots.
+ */
+void StepInstr(BlockCache::OpFunc fn, const Asm::Instruction& instr)
+{
+    InstrContext ctx = beginInstr();
+    u8 modified_reg = fn(instr);
+    endInstr(ctx, modified_reg);
+}
 
 /*
  * Set the cpu's program counter to the specified address.
@@ -209,7 +505,7 @@ u8 ExecuteInstruction(u32 raw_instr)
     // decode
     Asm::Instruction instr = Asm::DecodeRawInstr(raw_instr);
     // execute
-    return (s.prim_opmap[instr.op])(instr);
+    return DispatchTable[dispatchIndex(instr)](instr);
 }
 
 /*
@@ -220,6 +516,39 @@ bool InBranchDelaySlot()
     return s.bds.is_primed;
 }
 
+/*
+ * Choose how instructions get executed. The plain interpreter fetches and
+ * decodes on every step, the cached interpreter runs pre-decoded blocks and
+ * the recompiler runs blocks translated to host code.
+ */
+void SetExecMode(ExecMode mode)
+{
+    if (mode == ExecMode::Recompiler && !Jit::IsSupported()) {
+        CPU_WARN("Recompiler not supported on this host, using Cached Interpreter");
+        mode = ExecMode::CachedInterpreter;
+    }
+    CPU_INFO("Switching to {}", execModeName(mode));
+    s.exec_mode = mode;
+    s.cursor = {};
+    resetTiers();
+    BlockCache::SetProtectCode(mode == ExecMode::Recompiler || mode == ExecMode::Tiered);
+}
+
+ExecMode GetExecMode()
+{
+    return s.exec_mode;
+}
+
+/*
+ * Set how many times a block has to be entered before the tiered mode moves
+ * it into the block cache (warm) and then the recompiler (hot).
+ */
+void SetTierThresholds(u32 warm, u32 hot)
+{
+    s.tiers.warm_threshold = std::max(warm, 1u);
+    s.tiers.hot_threshold = std::max(hot, s.tiers.warm_threshold);
+}
+
 /*
  * Update function for ImGui.
  */
@@ -277,6 +606,83 @@ void OnActive(bool *active)
     }
     //-------------------------------------
 
+    //-------------------------------------
+    // Execution Mode
+    //-------------------------------------
+    int mode = static_cast<int>(s.exec_mode);
+    bool mode_changed = false;
+    ImGui::TextUnformatted("Execution Mode:");
+    ImGui::SameLine();
+    mode_changed |= ImGui::RadioButton("Interpreter", &mode, static_cast<int>(ExecMode::Interpreter));
+    ImGui::SameLine();
+    mode_changed |= ImGui::RadioButton("Cached Interpreter", &mode, static_cast<int>(ExecMode::CachedInterpreter));
+    if (Jit::IsSupported()) {
+        ImGui::SameLine();
+        mode_changed |= ImGui::RadioButton("Recompiler", &mode, static_cast<int>(ExecMode::Recompiler));
+    }
+    ImGui::SameLine();
+    mode_changed |= ImGui::RadioButton("Tiered", &mode, static_cast<int>(ExecMode::Tiered));
+    if (mode_changed) {
+        SetExecMode(static_cast<ExecMode>(mode));
+    }
+    ImGui::SameLine();
+    ImGui::TextUnformatted(PSX_FMT("| Cached Blocks: {} | Invalidations: {}",
+        BlockCache::NumBlocks(), BlockCache::NumInvalidations()).c_str());
+    if (Jit::IsSupported()) {
+        ImGui::SameLine();
+        ImGui::TextUnformatted(PSX_FMT("| Compiled: {} | Code: {} / {} KB",
+            Jit::NumCompiled(), Jit::CodeBytesUsed() / 1024, Jit::CodeBytesTotal() / 1024).c_str());
+    }
+    ImGui::SameLine();
+    ImGui::TextUnformatted(PSX_FMT("| Idle Skipped: {} cycles", s.idle_cycles_skipped).c_str());
+    ImGui::SameLine();
+    ImGui::TextUnformatted(PSX_FMT("| I-Cache: {} ({} hits, {} misses)", ICache::IsEnabled() ? "On" : "Off",
+        ICache::NumHits(), ICache::NumMisses()).c_str());
+    if (s.cached_instrs != 0) {
+        ImGui::SameLine();
+        ImGui::TextUnformatted(PSX_FMT("| Fused: {:.1f}%",
+            200.0 * static_cast<double>(s.fused_pairs) / static_cast<double>(s.cached_instrs)).c_str());
+    }
+    if (Jit::IsSupported() && (s.exec_mode == ExecMode::Recompiler || s.exec_mode == ExecMode::Tiered)) {
+        bool optimize = Jit::GetOptimize();
+        if (ImGui::Checkbox("Optimize", &optimize)) {
+            Jit::SetOptimize(optimize);
+        }
+        Jit::OptStats opt = Jit::GetOptStats();
+        ImGui::SameLine();
+        ImGui::TextUnformatted(PSX_FMT("| Folded: {} | Dead Writes: {} | Overflow Checks Removed: {} | Direct Mem: {} (of {} instrs)",
+            opt.const_folds, opt.dead_writes, opt.no_overflow, opt.direct_mem, opt.instrs).c_str());
+        if (Fastmem::IsEnabled()) {
+            bool fastmem = Jit::GetFastmem();
+            if (ImGui::Checkbox("Fastmem", &fastmem)) {
+                Jit::SetFastmem(fastmem);
+            }
+            ImGui::SameLine();
+            ImGui::TextUnformatted(PSX_FMT("| Faults: {} | Patched: {}",
+                Jit::NumFastmemFaults(), Jit::NumFastmemPatches()).c_str());
+        }
+    }
+    if (s.exec_mode == ExecMode::Tiered) {
+        auto& tiers = s.tiers;
+        int warm = static_cast<int>(tiers.warm_threshold);
+        int hot = static_cast<int>(tiers.hot_threshold);
+        bool changed = ImGui::InputInt("Warm Threshold", &warm);
+        ImGui::SameLine();
+        changed |= ImGui::InputInt("Hot Threshold", &hot);
+        if (changed) {
+            SetTierThresholds(static_cast<u32>(std::max(warm, 1)), static_cast<u32>(std::max(hot, 1)));
+        }
+        double total = static_cast<double>(std::max<u64>(tiers.cold_instrs + tiers.warm_instrs + tiers.hot_instrs, 1));
+        ImGui::TextUnformatted(PSX_FMT("Interpreted: {:.1f}% | Cached: {:.1f}% | Recompiled: {:.1f}% | Promoted: {} warm, {} hot",
+            100.0 * static_cast<double>(tiers.cold_instrs) / total,
+            100.0 * static_cast<double>(tiers.warm_instrs) / total,
+            100.0 * static_cast<double>(tiers.hot_instrs) / total,
+            tiers.warm_promotions, tiers.hot_promotions).c_str());
+        ImGui::TextUnformatted(PSX_FMT("Translation Cache: {} loaded | {} hits | {} recorded",
+            TransCache::NumLoaded(), TransCache::NumHits(), TransCache::NumRecorded()).c_str());
+    }
+    //-------------------------------------
+
     u32 pc = s.regs.pc;
     u32 prePC = pc_region > pc ? 0 : pc - pc_region;
     u32 postPC = s.regs.pc + pc_region;
@@ -388,7 +794,7 @@ void OnActive(bool *active)
  */
 u8 Special(const Asm::Instruction& instr)
 {
-    return (s.sec_opmap[instr.funct])(instr);
+    return DispatchTable[SecondaryBase + instr.funct](instr);
 }
 
 /*
@@ -398,14 +804,7 @@ u8 Special(const Asm::Instruction& instr)
  */
 u8 Bcondz(const Asm::Instruction& instr)
 {
-    // check if in map
-    auto iter = s.bcondz_opmap.find(instr.bcondz_op);
-    if (iter != s.bcondz_opmap.end()) {
-        // found!
-        return (iter->second)(instr);
-    } else {
-        return BadOp(instr);
-    }
+    return DispatchTable[BcondzBase + instr.bcondz_op](instr);
 }
 
 //================================================
@@ -786,12 +1185,9 @@ u8 Srl(const Asm::Instruction& instr)
  */
 u8 Sra(const Asm::Instruction& instr)
 {
-    bool msb = (s.regs.r[instr.rt] & 0x8000'0000) != 0;
-    u32 upper_bits = (0xffff'ffff << (32 - instr.shamt));
-    s.regs.r[instr.rd] = s.regs.r[instr.rt] >> instr.shamt;
-    if (msb) {
-        s.regs.r[instr.rd] |= upper_bits;
-    }
+    // right shift of a signed value is arithmetic (C++20)
+    i32 rt = static_cast<i32>(s.regs.r[instr.rt]);
+    s.regs.r[instr.rd] = static_cast<u32>(rt >> instr.shamt);
     return instr.rd;
 }
 
@@ -827,13 +1223,10 @@ u8 Srlv(const Asm::Instruction& instr)
  */
 u8 Srav(const Asm::Instruction& instr)
 {
-    bool msb = (s.regs.r[instr.rt] & 0x8000'0000) != 0;
+    // right shift of a signed value is arithmetic (C++20)
+    i32 rt = static_cast<i32>(s.regs.r[instr.rt]);
     u32 rs = s.regs.r[instr.rs] & 0x1f; // only 5 lsb
-    u32 upper_bits = (0xffff'ffff << (32 - rs));
-    s.regs.r[instr.rd] = s.regs.r[instr.rt] >> rs;
-    if (msb) {
-        s.regs.r[instr.rd] |= upper_bits;
-    }
+    s.regs.r[instr.rd] = static_cast<u32>(rt >> rs);
     return instr.rd;
 }
 
@@ -993,6 +1386,16 @@ static inline u32 signExtendTo32(u8 val)
 
 // *** Load ***
 
+/*
+ * Nothing answered the access, see Bus::IsBusError.
+ */
+static void raiseBusError()
+{
+    Cop0::Exception e;
+    e.type = Cop0::Exception::Type::DBusErr;
+    Cop0::RaiseException(e);
+}
+
 /*
  * Load Byte
  * op = 0x20
@@ -1002,6 +1405,10 @@ static inline u32 signExtendTo32(u8 val)
 u8 Lb(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u8 byte = Bus::Read<u8>(addr);
     // Load Delay
     s.lds.is_primed = true;
@@ -1019,6 +1426,10 @@ u8 Lb(const Asm::Instruction& instr)
 u8 Lbu(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u8 byte = Bus::Read<u8>(addr);
     // Load Delay!
     s.lds.is_primed = true;
@@ -1041,6 +1452,8 @@ u8 Lh(const Asm::Instruction& instr)
         Cop0::Exception e;
         e.type = Cop0::Exception::Type::AddrErrLoad;
         Cop0::RaiseException(e);
+    } else if (Bus::IsBusError(addr)) {
+        raiseBusError();
     } else {
         u16 halfword = Bus::Read<u16>(addr);
         // Load Delay!
@@ -1065,6 +1478,8 @@ u8 Lhu(const Asm::Instruction& instr)
         Cop0::Exception e;
         e.type = Cop0::Exception::Type::AddrErrLoad;
         Cop0::RaiseException(e);
+    } else if (Bus::IsBusError(addr)) {
+        raiseBusError();
     } else {
         u16 halfword = Bus::Read<u16>(addr);
         // Load Delay!
@@ -1089,6 +1504,8 @@ u8 Lw(const Asm::Instruction& instr)
         Cop0::Exception e;
         e.type = Cop0::Exception::Type::AddrErrLoad;
         Cop0::RaiseException(e);
+    } else if (Bus::IsBusError(addr)) {
+        raiseBusError();
     } else {
         // Load Delay!
         s.lds.is_primed = true;
@@ -1107,6 +1524,10 @@ u8 Lw(const Asm::Instruction& instr)
 u8 Lwl(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u32 shift_to_align = (addr & 0x3) << 3; // mult by 8
     // read from 4-aligned addr
     u32 data = Bus::Read<u32>(addr & ~0x3u);
@@ -1129,6 +1550,10 @@ u8 Lwl(const Asm::Instruction& instr)
 u8 Lwr(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u32 shift_to_align = (addr & 0x3) << 3; // mult by 8
     // read from 4-aligned addr
     u32 data = Bus::Read<u32>(addr & ~0x3u);
@@ -1152,6 +1577,10 @@ u8 Lwr(const Asm::Instruction& instr)
 u8 Sb(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u8 rt = s.regs.r[instr.rt] & 0xff;
     Bus::Write<u8>(rt, addr);
     return 0;
@@ -1172,6 +1601,8 @@ u8 Sh(const Asm::Instruction& instr)
         Cop0::Exception e;
         e.type = Cop0::Exception::Type::AddrErrStore;
         Cop0::RaiseException(e);
+    } else if (Bus::IsBusError(addr)) {
+        raiseBusError();
     } else {
         u16 rt = s.regs.r[instr.rt] & 0xffff;
         Bus::Write<u16>(rt, addr);
@@ -1193,6 +1624,8 @@ u8 Sw(const Asm::Instruction& instr)
         Cop0::Exception e;
         e.type = Cop0::Exception::Type::AddrErrStore;
         Cop0::RaiseException(e);
+    } else if (Bus::IsBusError(addr)) {
+        raiseBusError();
     } else {
         u32 rt = s.regs.r[instr.rt];
         Bus::Write<u32>(rt, addr);
@@ -1210,6 +1643,10 @@ u8 Sw(const Asm::Instruction& instr)
 u8 Swl(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u32 shift_to_align = (addr & 0x3) << 3; // mult by 8
     // read from 4-aligned addr
     u32 old_data = Bus::Read<u32>(addr & ~0x3u);
@@ -1230,6 +1667,10 @@ u8 Swl(const Asm::Instruction& instr)
 u8 Swr(const Asm::Instruction& instr)
 {
     u32 addr = signExtendTo32(instr.imm16) + s.regs.r[instr.rs];
+    if (Bus::IsBusError(addr)) {
+        raiseBusError();
+        return 0;
+    }
     u32 shift_to_align = (addr & 0x3) << 3; // mult by 8
     // read from 4-aligned addr
     u32 old_data = Bus::Read<u32>(addr & ~0x3u);
@@ -1615,90 +2056,559 @@ u8 SwC3(const Asm::Instruction& instr)
 namespace  {
 
 /*
- * Build the cpu op maps to be used during the execution cycle.
+ * Find the final handler for an instruction, looking through the Special and
+ * Bcondz indirections.
  */
-void buildOpMaps()
+opfunc resolveOp(const Psx::Cpu::Asm::Instruction& instr)
 {
-    using namespace Psx::Cpu;
-    // Primary Op Encoding
-    s.prim_opmap[0x00] = Special; s.prim_opmap[0x01] = Bcondz;
-    s.prim_opmap[0x02] = J;       s.prim_opmap[0x03] = Jal;
-    s.prim_opmap[0x04] = Beq;     s.prim_opmap[0x05] = Bne;
-    s.prim_opmap[0x06] = Blez;    s.prim_opmap[0x07] = Bgtz;
-    s.prim_opmap[0x08] = Addi;    s.prim_opmap[0x09] = Addiu;
-    s.prim_opmap[0x0a] = Slti;    s.prim_opmap[0x0b] = Sltiu;
-    s.prim_opmap[0x0c] = Andi;    s.prim_opmap[0x0d] = Ori;
-    s.prim_opmap[0x0e] = Xori;    s.prim_opmap[0x0f] = Lui;
-
-    s.prim_opmap[0x10] = Cop0;    s.prim_opmap[0x11] = Cop1;
-    s.prim_opmap[0x12] = Cop2;    s.prim_opmap[0x13] = Cop3;
-    s.prim_opmap[0x14] = BadOp;   s.prim_opmap[0x15] = BadOp;
-    s.prim_opmap[0x16] = BadOp;   s.prim_opmap[0x17] = BadOp;
-    s.prim_opmap[0x18] = BadOp;   s.prim_opmap[0x19] = BadOp;
-    s.prim_opmap[0x1a] = BadOp;   s.prim_opmap[0x1b] = BadOp;
-    s.prim_opmap[0x1c] = BadOp;   s.prim_opmap[0x1d] = BadOp;
-    s.prim_opmap[0x1e] = BadOp;   s.prim_opmap[0x1f] = BadOp;
-
-    s.prim_opmap[0x20] = Lb;      s.prim_opmap[0x21] = Lh;
-    s.prim_opmap[0x22] = Lwl;     s.prim_opmap[0x23] = Lw;
-    s.prim_opmap[0x24] = Lbu;     s.prim_opmap[0x25] = Lhu;
-    s.prim_opmap[0x26] = Lwr;     s.prim_opmap[0x27] = BadOp;
-    s.prim_opmap[0x28] = Sb;      s.prim_opmap[0x29] = Sh;
-    s.prim_opmap[0x2a] = Swl;     s.prim_opmap[0x2b] = Sw;
-    s.prim_opmap[0x2c] = BadOp;   s.prim_opmap[0x2d] = BadOp;
-    s.prim_opmap[0x2e] = Swr;     s.prim_opmap[0x2f] = BadOp;
-
-    s.prim_opmap[0x30] = LwC0;    s.prim_opmap[0x31] = LwC1;
-    s.prim_opmap[0x32] = LwC2;    s.prim_opmap[0x33] = LwC3;
-    s.prim_opmap[0x34] = BadOp;   s.prim_opmap[0x35] = BadOp;
-    s.prim_opmap[0x36] = BadOp;   s.prim_opmap[0x37] = BadOp;
-    s.prim_opmap[0x38] = SwC0;    s.prim_opmap[0x39] = SwC1;
-    s.prim_opmap[0x3a] = SwC2;    s.prim_opmap[0x3b] = SwC3;
-    s.prim_opmap[0x3c] = BadOp;   s.prim_opmap[0x3d] = BadOp;
-    s.prim_opmap[0x3e] = BadOp;   s.prim_opmap[0x3f] = BadOp;
+    return DispatchTable[dispatchIndex(instr)];
+}
 
-    // Secondary Op Encoding
-    s.sec_opmap[0x00] = Sll;     s.sec_opmap[0x01] = BadOp;
-    s.sec_opmap[0x02] = Srl;     s.sec_opmap[0x03] = Sra;
-    s.sec_opmap[0x04] = Sllv;    s.sec_opmap[0x05] = BadOp;
-    s.sec_opmap[0x06] = Srlv;    s.sec_opmap[0x07] = Srav;
-    s.sec_opmap[0x08] = Jr;      s.sec_opmap[0x09] = Jalr;
-    s.sec_opmap[0x0a] = BadOp;   s.sec_opmap[0x0b] = BadOp;
-    s.sec_opmap[0x0c] = Syscall; s.sec_opmap[0x0d] = Break;
-    s.sec_opmap[0x0e] = BadOp;   s.sec_opmap[0x0f] = BadOp;
-
-    s.sec_opmap[0x10] = Mfhi;    s.sec_opmap[0x11] = Mthi;
-    s.sec_opmap[0x12] = Mflo;    s.sec_opmap[0x13] = Mtlo;
-    s.sec_opmap[0x14] = BadOp;   s.sec_opmap[0x15] = BadOp;
-    s.sec_opmap[0x16] = BadOp;   s.sec_opmap[0x17] = BadOp;
-    s.sec_opmap[0x18] = Mult;    s.sec_opmap[0x19] = Multu;
-    s.sec_opmap[0x1a] = Div;     s.sec_opmap[0x1b] = Divu;
-    s.sec_opmap[0x1c] = BadOp;   s.sec_opmap[0x1d] = BadOp;
-    s.sec_opmap[0x1e] = BadOp;   s.sec_opmap[0x1f] = BadOp;
-
-    s.sec_opmap[0x20] = Add;     s.sec_opmap[0x21] = Addu;
-    s.sec_opmap[0x22] = Sub;     s.sec_opmap[0x23] = Subu;
-    s.sec_opmap[0x24] = And;     s.sec_opmap[0x25] = Or;
-    s.sec_opmap[0x26] = Xor;     s.sec_opmap[0x27] = Nor;
-    s.sec_opmap[0x28] = BadOp;   s.sec_opmap[0x29] = BadOp;
-    s.sec_opmap[0x2a] = Slt;     s.sec_opmap[0x2b] = Sltu;
-    s.sec_opmap[0x2c] = BadOp;   s.sec_opmap[0x2d] = BadOp;
-    s.sec_opmap[0x2e] = BadOp;   s.sec_opmap[0x2f] = BadOp;
-
-    s.sec_opmap[0x30] = BadOp;   s.sec_opmap[0x31] = BadOp;
-    s.sec_opmap[0x32] = BadOp;   s.sec_opmap[0x33] = BadOp;
-    s.sec_opmap[0x34] = BadOp;   s.sec_opmap[0x35] = BadOp;
-    s.sec_opmap[0x36] = BadOp;   s.sec_opmap[0x37] = BadOp;
-    s.sec_opmap[0x38] = BadOp;   s.sec_opmap[0x39] = BadOp;
-    s.sec_opmap[0x3a] = BadOp;   s.sec_opmap[0x3b] = BadOp;
-    s.sec_opmap[0x3c] = BadOp;   s.sec_opmap[0x3d] = BadOp;
-    s.sec_opmap[0x3e] = BadOp;   s.sec_opmap[0x3f] = BadOp;
+// every handler reachable from the dispatch table
+#define CPU_HANDLERS(X) \
+    X(BadOp) X(Special) X(Bcondz) \
+    X(Addi) X(Addiu) X(Slti) X(Sltiu) X(Andi) X(Ori) X(Xori) X(Lui) \
+    X(Add) X(Addu) X(Sub) X(Subu) X(Slt) X(Sltu) X(And) X(Or) X(Xor) X(Nor) \
+    X(Sll) X(Srl) X(Sra) X(Sllv) X(Srlv) X(Srav) \
+    X(Mult) X(Multu) X(Div) X(Divu) X(Mfhi) X(Mflo) X(Mthi) X(Mtlo) \
+    X(Lb) X(Lbu) X(Lh) X(Lhu) X(Lw) X(Lwl) X(Lwr) X(Sb) X(Sh) X(Sw) X(Swl) X(Swr) \
+    X(J) X(Jal) X(Jr) X(Jalr) X(Beq) X(Bne) X(Blez) X(Bgtz) \
+    X(Bltz) X(Bgez) X(Bltzal) X(Bgezal) X(Syscall) X(Break) \
+    X(Cop0) X(Cop1) X(Cop2) X(Cop3) X(LwC0) X(LwC1) X(LwC2) X(LwC3) \
+    X(SwC0) X(SwC1) X(SwC2) X(SwC3)
 
-    // Bcondz Op encoding
-    s.bcondz_opmap[0x00] = Bltz;
-    s.bcondz_opmap[0x01] = Bgez;
-    s.bcondz_opmap[0x10] = Bltzal;
-    s.bcondz_opmap[0x11] = Bgezal;
+/*
+ * Pc breakpoints for batches run by the interpreter, every other mode has
+ * Run() check them after each step. Always false without PSX_DEBUG.
+ */
+inline bool breakpointHit()
+{
+#ifdef PSX_DEBUG
+    using namespace Psx::View::ImGuiLayer::DbgMod;
+    if (!s.in_run || s.exec_mode != ExecMode::Interpreter) {
+        return false;
+    }
+    Breakpoints::Saw<Breakpoints::BrkType::PCWatch>(s.regs.pc);
+    return Breakpoints::ReadyToBreak();
+#else
+    return false;
+#endif
+}
+
+/*
+ * Fetch, decode and execute up to count instructions, stopping early if an
+ * exit gets requested or a breakpoint is hit. Returns the number of instructions run. With
+ * GCC/Clang this is a threaded interpreter: each handler gets its own label
+ * that calls it directly (so it can be inlined) and then jumps straight to
+ * the next instruction's label.
+ */
+#if defined(__GNUC__)
+// labels as values are a GNU extension
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+u32 interpret(u32 count)
+{
+    using namespace Psx;
+    static void *labels[DispatchSize] = {nullptr};
+    if (labels[0] == nullptr) {
+        for (u32 i = 0; i < DispatchSize; i++) {
+#define CPU_LABEL_ENTRY(name) if (DispatchTable[i] == Cpu::name) labels[i] = &&op_##name;
+            CPU_HANDLERS(CPU_LABEL_ENTRY)
+#undef CPU_LABEL_ENTRY
+        }
+    }
+
+    // fetches go through the i-cache, the other modes only follow its
+    // flushes (see ICache::Write)
+    Cpu::Asm::Instruction instr;
+    InstrContext ctx;
+    u8 modified_reg;
+    u32 ran = 0;
+#define CPU_DISPATCH() \
+    instr = Cpu::Asm::DecodeRawInstr(Cpu::ICache::Fetch(s.regs.pc)); \
+    ctx = beginInstr(); \
+    goto *labels[dispatchIndex(instr)]
+
+    CPU_DISPATCH();
+#define CPU_HANDLER_LABEL(name) op_##name: modified_reg = Cpu::name(instr); goto retire;
+    CPU_HANDLERS(CPU_HANDLER_LABEL)
+#undef CPU_HANDLER_LABEL
+
+retire:
+    endInstr(ctx, modified_reg);
+    s.run_cycles++;
+    if (++ran == count || s.exit_requested || breakpointHit()) {
+        return ran;
+    }
+    CPU_DISPATCH();
+#undef CPU_DISPATCH
+}
+#pragma GCC diagnostic pop
+#else
+u32 interpret(u32 count)
+{
+    u32 ran = 0;
+    while (ran < count) {
+        Psx::Cpu::Asm::Instruction instr = Psx::Cpu::Asm::DecodeRawInstr(Psx::Cpu::ICache::Fetch(s.regs.pc));
+        Psx::Cpu::StepInstr(DispatchTable[dispatchIndex(instr)], instr);
+        s.run_cycles++;
+        ran++;
+        if (s.exit_requested || breakpointHit()) {
+            break;
+        }
+    }
+    return ran;
+}
+#endif
+
+/*
+ * Returns true if the instruction is a jump or branch (has a delay slot).
+ */
+bool isBranch(const Psx::Cpu::Asm::Instruction& instr)
+{
+    if (instr.op == 0x00) {
+        return instr.funct == 0x08 || instr.funct == 0x09; // JR, JALR
+    }
+    return instr.op >= 0x01 && instr.op <= 0x07;
+}
+
+/*
+ * Decode the block starting at pc and add it to the block cache. Returns
+ * nullptr if the code at pc can't be cached.
+ */
+Psx::Cpu::BlockCache::Block* buildBlock(u32 pc)
+{
+    using namespace Psx;
+    if (!Cpu::BlockCache::IsCacheable(pc)) {
+        return nullptr;
+    }
+
+    Cpu::BlockCache::Block block;
+    block.pc = pc;
+    bool in_delay_slot = false;
+    for (u32 addr = pc; block.instrs.size() < Cpu::BlockCache::MaxBlockLen; addr += 4) {
+        if (!Cpu::BlockCache::IsCacheable(addr)) {
+            break;
+        }
+        Cpu::Asm::Instruction instr = Cpu::Asm::DecodeRawInstr(Bus::Read<u32>(addr));
+        block.instrs.push_back({resolveOp(instr), instr});
+        // blocks end after the delay slot of the first branch
+        if (in_delay_slot) {
+            break;
+        }
+        in_delay_slot = isBranch(instr);
+    }
+    block.idle_loop = isIdleLoop(block);
+    fuseBlock(block);
+    analyzeDelaySlots(block);
+    return Cpu::BlockCache::Insert(std::move(block));
+}
+
+/*
+ * Returns true if running the instruction only changes cpu registers.
+ */
+bool isSideEffectFree(const Psx::Cpu::BlockCache::CachedInstr& ci)
+{
+    if (ci.fn == Psx::Cpu::BadOp) {
+        return false;
+    }
+    const auto& instr = ci.instr;
+    if (instr.op == 0x00) {
+        // shifts, hi/lo moves, mult/div and alu ops
+        return instr.funct < 0x08 || (instr.funct >= 0x10 && instr.funct <= 0x2b);
+    }
+    // alu immediates and loads
+    return (instr.op >= 0x08 && instr.op <= 0x0f) || (instr.op >= 0x20 && instr.op <= 0x26);
+}
+
+/*
+ * Returns true if the block is a short loop branching back to its own start
+ * where every other instruction only reads memory or touches registers, like
+ * a loop polling I_STAT or a timer's flags.
+ */
+bool isIdleLoop(const Psx::Cpu::BlockCache::Block& block)
+{
+    constexpr size_t IdleLoopMaxLen = 16;
+    size_t n = block.instrs.size();
+    if (n < 2 || n > IdleLoopMaxLen) {
+        return false;
+    }
+
+    // only direct branches without a link can loop back to a known address
+    const Psx::Cpu::Asm::Instruction& br = block.instrs[n - 2].instr;
+    u32 next_pc = block.pc + static_cast<u32>(n - 1) * 4;
+    u32 target;
+    if (br.op == 0x02) {
+        target = (next_pc & 0xf000'0000) | (br.target << 2);
+    } else if ((br.op >= 0x04 && br.op <= 0x07) || (br.op == 0x01 && br.bcondz_op <= 0x01)) {
+        target = next_pc + (Psx::Cpu::signExtendTo32(br.imm16) << 2);
+    } else {
+        return false;
+    }
+    if (target != block.pc) {
+        return false;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        if (i != n - 2 && !isSideEffectFree(block.instrs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Called before every block run by Run(). Returns true once an idle loop gets
+ * back to its start with the cpu state exactly as it was last time around.
+ * Only the cpu and scheduled events can change memory, and a batch never runs
+ * past the next event, so every iteration left in the batch would be the same.
+ * Reads of registers that change on their own disarm it (see BreakIdleLoop).
+ */
+bool checkIdleLoop(const Psx::Cpu::BlockCache::Block *block)
+{
+    auto& idle = s.idle;
+    if (!s.in_run || block == nullptr || !block->idle_loop) {
+        // something else ran, memory may have changed
+        idle.armed = false;
+        return false;
+    }
+
+    bool same = idle.armed && idle.pc == block->pc
+        && idle.regs.hi == s.regs.hi && idle.regs.lo == s.regs.lo
+        && std::equal(std::begin(idle.regs.r), std::end(idle.regs.r), std::begin(s.regs.r))
+        && idle.lds.is_primed == s.lds.is_primed
+        && (!s.lds.is_primed || (idle.lds.reg == s.lds.reg && idle.lds.val == s.lds.val));
+    if (same) {
+        s.idle_hit = true;
+        return true;
+    }
+
+    idle.armed = true;
+    idle.pc = block->pc;
+    idle.regs = s.regs;
+    idle.lds = s.lds;
+    return false;
+}
+
+/*
+ * Bookkeeping for the first instruction of a fused pair. The first instruction
+ * never branches or loads, so all that's left of StepInstr is committing the
+ * load delay slot it may be sitting in.
+ */
+inline void endFusedFirst(u8 modified_reg)
+{
+    if (s.lds.is_primed && modified_reg != s.lds.reg) {
+        s.regs.r[s.lds.reg] = s.lds.val;
+    }
+    s.lds.is_primed = false;
+    s.lds.was_primed = false;
+    s.bds.was_primed = false;
+    s.regs.r[0] = 0;
+}
+
+/*
+ * LUI+ORI and LUI+ADDIU building a constant in one register.
+ */
+u32 fusedLuiOri(const Psx::Cpu::BlockCache::CachedInstr& lui, const Psx::Cpu::BlockCache::CachedInstr& ori)
+{
+    endFusedFirst(lui.instr.rt);
+    s.regs.r[ori.instr.rt] = (static_cast<u32>(lui.instr.imm16) << 16) | ori.instr.imm16;
+    s.regs.pc += 8;
+    return 2;
+}
+
+u32 fusedLuiAddiu(const Psx::Cpu::BlockCache::CachedInstr& lui, const Psx::Cpu::BlockCache::CachedInstr& addiu)
+{
+    endFusedFirst(lui.instr.rt);
+    s.regs.r[addiu.instr.rt] = (static_cast<u32>(lui.instr.imm16) << 16) + Psx::Cpu::signExtendTo32(addiu.instr.imm16);
+    s.regs.pc += 8;
+    return 2;
+}
+
+/*
+ * Any other pair (LUI+load/store, SLT+branch). Both handlers still run, but
+ * with a single dispatch and none of the delay slot bookkeeping the first
+ * instruction can't need. The second instruction may load, branch or trap as
+ * usual. Returns 1 if the first instruction trapped.
+ */
+u32 fusedPair(const Psx::Cpu::BlockCache::CachedInstr& first, const Psx::Cpu::BlockCache::CachedInstr& second)
+{
+    s.regs.pc += 4;
+    u32 next_pc = s.regs.pc;
+    endFusedFirst(first.fn(first.instr));
+    if (s.regs.pc != next_pc) {
+        return 1;
+    }
+    s.regs.pc += 4;
+    second.fn(second.instr);
+    s.regs.r[0] = 0;
+    return 2;
+}
+
+/*
+ * Find the superinstructions in a block: common pairs of instructions that
+ * can run as one operation in the cached interpreter. Pairs never overlap and
+ * never include the branch delay slot.
+ */
+void fuseBlock(Psx::Cpu::BlockCache::Block& block)
+{
+    for (size_t i = 0; i + 1 < block.instrs.size(); i++) {
+        const Psx::Cpu::Asm::Instruction& a = block.instrs[i].instr;
+        const Psx::Cpu::Asm::Instruction& b = block.instrs[i + 1].instr;
+        Psx::Cpu::BlockCache::FusedFunc fused = nullptr;
+        if (a.op == 0x0f && a.rt != 0) {
+            // LUI
+            bool same_reg = b.rs == a.rt && b.rt == a.rt;
+            bool load_store = (b.op >= 0x20 && b.op <= 0x26) || (b.op >= 0x28 && b.op <= 0x2b) || b.op == 0x2e;
+            if (b.op == 0x0d && same_reg) {
+                fused = fusedLuiOri;
+            } else if (b.op == 0x09 && same_reg) {
+                fused = fusedLuiAddiu;
+            } else if (load_store && b.rs == a.rt) {
+                fused = fusedPair;
+            }
+        } else if (a.op == 0x00 && (a.funct == 0x2a || a.funct == 0x2b) && a.rd != 0) {
+            // SLT/SLTU, then BEQ/BNE on the result
+            bool on_result = (b.rs == a.rd && b.rt == 0) || (b.rs == 0 && b.rt == a.rd);
+            if ((b.op == 0x04 || b.op == 0x05) && on_result) {
+                fused = fusedPair;
+            }
+        }
+        if (fused != nullptr) {
+            block.instrs[i].fused = fused;
+            i++;
+        }
+    }
+}
+
+inline bool isLoad(const Psx::Cpu::Asm::Instruction& instr)
+{
+    return instr.op >= 0x20 && instr.op <= 0x26;
+}
+
+/*
+ * Work out which instructions of a block can skip the delay slot bookkeeping
+ * in StepInstr. An instruction after one that neither branched nor left a load
+ * pending starts with both delay slots empty, which is most of them. A load
+ * followed by an instruction that doesn't touch the loaded register can commit
+ * its value right away, since nothing could tell the difference, and keeps
+ * the instruction after it on the fast path too. The first instruction of a
+ * block can't be proven, it may be entered with anything pending.
+ */
+void analyzeDelaySlots(Psx::Cpu::BlockCache::Block& block)
+{
+    auto& instrs = block.instrs;
+    for (size_t i = 1; i < instrs.size(); i++) {
+        const auto& prev = instrs[i - 1];
+        auto& ci = instrs[i];
+        ci.no_delay = !isBranch(prev.instr) && (!isLoad(prev.instr) || prev.commit_load);
+        if (!ci.no_delay || !isLoad(ci.instr) || i + 1 == instrs.size() || prev.fused != nullptr) {
+            // fused pairs run their second half without the fast path
+            continue;
+        }
+        // back to back loads race over the slot, leave those to StepInstr
+        const Psx::Cpu::Asm::Instruction& next = instrs[i + 1].instr;
+        u8 reg = ci.instr.rt;
+        ci.commit_load = !isLoad(next) && next.rs != reg && next.rt != reg && next.rd != reg;
+    }
+}
+
+/*
+ * StepInstr for an instruction that analyzeDelaySlots proved has nothing
+ * pending in either delay slot.
+ */
+inline void stepNoDelay(const Psx::Cpu::BlockCache::CachedInstr& ci)
+{
+    s.bds.was_primed = false;
+    s.lds.was_primed = false;
+    s.regs.pc += 4;
+    ci.fn(ci.instr);
+    if (ci.commit_load && s.lds.is_primed) {
+        s.regs.r[s.lds.reg] = s.lds.val;
+        s.lds.is_primed = false;
+    }
+    s.regs.r[0] = 0;
+}
+
+/*
+ * Execute one instruction using the pre-decoded blocks. Falls back to the
+ * interpreter for code that isn't cacheable. Returns the number of
+ * instructions executed (0 when an idle loop was detected instead).
+ */
+u32 stepCached()
+{
+    using namespace Psx;
+    auto& cur = s.cursor;
+    if (cur.block == nullptr || cur.pc != s.regs.pc || cur.generation != Cpu::BlockCache::Generation()) {
+        // left the current block, find the next one
+        cur.block = Cpu::BlockCache::Lookup(s.regs.pc);
+        if (cur.block == nullptr) {
+            cur.block = buildBlock(s.regs.pc);
+        }
+        cur.index = 0;
+        cur.pc = s.regs.pc;
+        cur.generation = Cpu::BlockCache::Generation();
+        if (checkIdleLoop(cur.block)) {
+            cur.block = nullptr;
+            return 0;
+        }
+        if (cur.block == nullptr) {
+            Cpu::Asm::Instruction instr = Cpu::Asm::DecodeRawInstr(Bus::Read<u32>(s.regs.pc));
+            StepInstr(resolveOp(instr), instr);
+            return 1;
+        }
+    }
+
+    // copy, the instruction may invalidate its own block
+    Cpu::BlockCache::CachedInstr ci = cur.block->instrs[cur.index++];
+    cur.pc += 4;
+    if (ci.fused != nullptr && s.in_run && !s.bds.is_primed) {
+        // the second half of a pair is always in the same block
+        Cpu::BlockCache::CachedInstr second = cur.block->instrs[cur.index++];
+        cur.pc += 4;
+        if (cur.index == cur.block->instrs.size()) {
+            cur.block = nullptr;
+        }
+        u32 ran = ci.fused(ci, second);
+        s.fused_pairs += ran == 2 ? 1 : 0;
+        s.cached_instrs += ran;
+        return ran;
+    }
+    if (cur.index == cur.block->instrs.size()) {
+        cur.block = nullptr;
+    }
+    if (ci.no_delay) {
+        stepNoDelay(ci);
+    } else {
+        StepInstr(ci.fn, ci.instr);
+    }
+    s.cached_instrs++;
+    return 1;
+}
+
+/*
+ * Run the block at the current pc as host code, compiling it first if
+ * needed. Falls back to the interpreter for code that isn't cacheable.
+ * Returns the number of instructions executed (0 when an idle loop was
+ * detected instead).
+ */
+u32 stepRecompiled()
+{
+    using namespace Psx;
+    Cpu::BlockCache::Block *block = Cpu::BlockCache::Lookup(s.regs.pc);
+    if (block == nullptr) {
+        block = buildBlock(s.regs.pc);
+    }
+    if (checkIdleLoop(block)) {
+        return 0;
+    }
+    if (block == nullptr) {
+        Cpu::Asm::Instruction instr = Cpu::Asm::DecodeRawInstr(Bus::Read<u32>(s.regs.pc));
+        StepInstr(resolveOp(instr), instr);
+        return 1;
+    }
+
+    if (block->jit_fn == nullptr || block->jit_epoch != Cpu::Jit::Epoch()) {
+        block->jit_fn = Cpu::Jit::Compile(*block);
+        block->jit_epoch = Cpu::Jit::Epoch();
+        if (block->jit_fn == nullptr) {
+            Cpu::BlockCache::CachedInstr ci = block->instrs[0];
+            StepInstr(ci.fn, ci.instr);
+            return 1;
+        }
+    }
+    // the block may get dropped while it runs, don't touch it after this
+    return Cpu::Jit::Run(block->jit_fn);
+}
+
+/*
+ * Run the next instruction in the tier its block has earned. Blocks that
+ * haven't been entered warm_threshold times yet are interpreted without being
+ * decoded, then they go through the block cache until they've been entered
+ * hot_threshold times and get recompiled. Returns the number of instructions
+ * executed.
+ */
+u32 stepTiered()
+{
+    using namespace Psx;
+    auto& tiers = s.tiers;
+    auto& cur = s.cursor;
+    if (tiers.in_cold_block) {
+        return stepCold();
+    }
+    if (cur.block != nullptr && cur.pc == s.regs.pc && cur.generation == Cpu::BlockCache::Generation()) {
+        // in the middle of a cached block
+        u32 ran = stepCached();
+        tiers.warm_instrs += ran;
+        return ran;
+    }
+
+    Cpu::BlockCache::Block *block = Cpu::BlockCache::Lookup(s.regs.pc);
+    if (block == nullptr && Cpu::BlockCache::IsCacheable(s.regs.pc) && Cpu::TransCache::IsHot(s.regs.pc)) {
+        // got hot in an earlier run, skip the warm up
+        tiers.profile.erase(s.regs.pc);
+        block = buildBlock(s.regs.pc);
+        block->exec_count = tiers.hot_threshold;
+    }
+    if (block == nullptr) {
+        if (!Cpu::BlockCache::IsCacheable(s.regs.pc) || ++tiers.profile[s.regs.pc] < tiers.warm_threshold) {
+            tiers.in_cold_block = true;
+            return stepCold();
+        }
+        tiers.profile.erase(s.regs.pc);
+        tiers.warm_promotions++;
+    } else if (Cpu::Jit::IsSupported()
+               && (block->exec_count >= tiers.hot_threshold || ++block->exec_count >= tiers.hot_threshold)) {
+        if (block->jit_fn == nullptr) {
+            tiers.hot_promotions++;
+            Cpu::TransCache::Record(*block);
+        }
+        u32 ran = stepRecompiled();
+        tiers.hot_instrs += ran;
+        return ran;
+    }
+    u32 ran = stepCached();
+    tiers.warm_instrs += ran;
+    return ran;
+}
+
+/*
+ * Interpret one instruction of a cold block. Cold blocks end after a branch
+ * delay slot, the same as cached blocks do.
+ */
+u32 stepCold()
+{
+    checkIdleLoop(nullptr);
+    u32 next_pc = s.regs.pc + 4;
+    interpret(1);
+    if (s.bds.was_primed || s.regs.pc != next_pc) {
+        s.tiers.in_cold_block = false;
+    }
+    s.tiers.cold_instrs++;
+    return 1;
+}
+
+void resetTiers()
+{
+    auto& tiers = s.tiers;
+    tiers.profile.clear();
+    tiers.in_cold_block = false;
+    tiers.cold_instrs = 0;
+    tiers.warm_instrs = 0;
+    tiers.hot_instrs = 0;
+    tiers.warm_promotions = 0;
+    tiers.hot_promotions = 0;
+}
+
+const char* execModeName(Psx::Cpu::ExecMode mode)
+{
+    switch (mode) {
+    case Psx::Cpu::ExecMode::Interpreter: return "Interpreter";
+    case Psx::Cpu::ExecMode::CachedInterpreter: return "Cached Interpreter";
+    case Psx::Cpu::ExecMode::Recompiler: return "Recompiler";
+    case Psx::Cpu::ExecMode::Tiered: return "Tiered";
+    }
+    return "Unknown";
 }
 
 }
@@ -21,11 +21,27 @@ namespace Psx {
 namespace Cpu {
 #include "cpu/_cpu_ops.hh"
 
+enum class ExecMode {
+    Interpreter,
+    CachedInterpreter,
+    Recompiler,
+    // blocks move from the interpreter to the block cache to the recompiler
+    // as they get hot (see SetTierThresholds)
+    Tiered,
+};
+
 void Init();
 void Reset();
 
 // functions
-void Step();
+u32 Step();
+u32 Run(u32 cycles);
+void RequestExit();
+void BreakIdleLoop();
+u32 CyclesThisRun();
+u64 IdleCyclesSkipped();
+u64 NumFusedPairs();
+u64 NumCachedInstrs();
 void SetPC(u32 addr);
 u32 GetPC();
 u32 GetR(size_t r);
@@ -36,6 +52,9 @@ u32 GetLO();
 void SetLO(u32 val);
 u8 ExecuteInstruction(u32 raw_instr);
 bool InBranchDelaySlot();
+void SetExecMode(ExecMode mode);
+ExecMode GetExecMode();
+void SetTierThresholds(u32 warm, u32 hot);
 
 // DbgModule Functions
 void OnActive(bool *active);
@@ -0,0 +1,182 @@
+/*
+ * icache.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * The 4KB instruction cache of the R3000A: 256 direct mapped lines of 4 words,
+ * each line tagged with the physical address it holds and a valid bit per
+ * word. Only fetches through kuseg and kseg0 are cached, kseg1 always goes to
+ * the bus. A miss fills the line from the missed word up to the end of the
+ * line, like the hardware does.
+ *
+ * The cache is only written to while it is isolated (see Bus::SetCacheIsolated),
+ * which is how the BIOS flushes it. Whatever a line held before gets
+ * invalidated in the block cache too, so pre-decoded and recompiled code
+ * follows the same flushes.
+ */
+
+#include "cpu/icache.hh"
+
+#include <array>
+
+#include "cpu/blockcache.hh"
+#include "mem/bus.hh"
+
+#define IC_INFO(...) PSXLOG_INFO("I-Cache", __VA_ARGS__)
+#define IC_WARN(...) PSXLOG_WARN("I-Cache", __VA_ARGS__)
+#define IC_ERROR(...) PSXLOG_ERROR("I-Cache", __VA_ARGS__)
+
+constexpr u32 WordsPerLine = Psx::Cpu::ICache::LineSize / 4;
+// physical address bits above the line index
+constexpr u32 TagMask = 0x1fff'f000;
+// valid bits live in the low bits of the tag, so a hit is a single compare
+constexpr u32 ValidMask = (1u << WordsPerLine) - 1;
+
+// *** Private Data and Helpers ***
+namespace  {
+struct Line {
+    u32 tag = 0;
+    u32 words[WordsPerLine] = {0};
+};
+
+struct State {
+    std::array<Line, Psx::Cpu::ICache::NumLines> lines;
+    bool enabled = false;
+    bool tag_test = false;
+    u64 hits = 0;
+    u64 misses = 0;
+} s;
+
+inline u32 lineIndex(u32 addr)
+{
+    return (addr / Psx::Cpu::ICache::LineSize) % Psx::Cpu::ICache::NumLines;
+}
+
+inline u32 wordIndex(u32 addr)
+{
+    return (addr >> 2) % WordsPerLine;
+}
+
+/*
+ * Kseg1 is the uncached view of memory.
+ */
+inline bool isCached(u32 addr)
+{
+    return addr < 0xa000'0000;
+}
+
+/*
+ * The line at index is about to change, drop any blocks decoded from what it
+ * held.
+ */
+void invalidateLine(u32 index)
+{
+    const Line& line = s.lines[index];
+    if ((line.tag & ValidMask) == 0) {
+        return;
+    }
+    u32 addr = (line.tag & TagMask) | (index * Psx::Cpu::ICache::LineSize);
+    // RAM (and its mirrors), the BIOS never changes
+    if (addr < 0x0080'0000) {
+        Psx::Cpu::BlockCache::InvalidateRam(addr);
+    }
+}
+}// end namespace
+
+namespace Psx {
+namespace Cpu {
+namespace ICache {
+
+void Init()
+{
+    IC_INFO("Initializing state");
+    Reset();
+}
+
+void Reset()
+{
+    IC_INFO("Resetting state");
+    s = {};
+}
+
+void SetControl(u32 cache_ctrl)
+{
+    s.enabled = (cache_ctrl >> 11) & 0x1;
+    s.tag_test = (cache_ctrl >> 2) & 0x1;
+}
+
+bool IsEnabled()
+{
+    return s.enabled;
+}
+
+/*
+ * Fetch the instruction word at pc, from the cache when it can.
+ */
+u32 Fetch(u32 pc)
+{
+    if (!s.enabled || !isCached(pc)) {
+        return Bus::Read<u32>(pc);
+    }
+
+    Line& line = s.lines[lineIndex(pc)];
+    u32 word = wordIndex(pc);
+    u32 tag = pc & TagMask;
+    u32 valid = 1u << word;
+    if ((line.tag & (TagMask | valid)) == (tag | valid)) {
+        s.hits++;
+        return line.words[word];
+    }
+
+    s.misses++;
+    if ((line.tag & TagMask) != tag) {
+        line.tag = tag;
+    }
+    u32 base = pc & ~(LineSize - 1);
+    for (u32 i = word; i < WordsPerLine; i++) {
+        line.words[i] = Bus::Read<u32>(base + 4 * i);
+        line.tag |= 1u << i;
+    }
+    return line.words[word];
+}
+
+/*
+ * Store while the cache is isolated. In tag test mode the line gets the tag
+ * of the address with every word invalid, which is how the BIOS flushes the
+ * cache one line at a time. Otherwise the store lands in the line's data
+ * (always a whole word, narrower stores write the word they're in).
+ */
+template<class T>
+void Write(T data, u32 addr)
+{
+    if (!isCached(addr)) {
+        return;
+    }
+    u32 index = lineIndex(addr);
+    invalidateLine(index);
+    Line& line = s.lines[index];
+    if (s.tag_test) {
+        line.tag = addr & TagMask;
+    } else {
+        line.words[wordIndex(addr)] = data;
+    }
+}
+// template impl needs to be visable to other cpp files to avoid compile err
+template void Write<u8>(u8 data, u32 addr);
+template void Write<u16>(u16 data, u32 addr);
+template void Write<u32>(u32 data, u32 addr);
+
+u64 NumHits()
+{
+    return s.hits;
+}
+
+u64 NumMisses()
+{
+    return s.misses;
+}
+
+}// end namespace
+}
+}
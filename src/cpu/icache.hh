@@ -0,0 +1,39 @@
+/*
+ * icache.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * The 4KB instruction cache of the R3000A.
+ */
+
+#pragma once
+
+#include "util/psxutil.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace ICache {
+
+constexpr u32 LineSize = 16;
+constexpr u32 NumLines = 256;
+
+void Init();
+void Reset();
+
+// cache control register (0xfffe'0130), bit 11 enables the cache and bit 2
+// makes isolated writes hit the tags instead of the data
+void SetControl(u32 cache_ctrl);
+bool IsEnabled();
+
+u32 Fetch(u32 pc);
+// store while the cache is isolated
+template<class T> void Write(T data, u32 addr);
+
+// stats
+u64 NumHits();
+u64 NumMisses();
+
+}// end namespace
+}
+}
@@ -10,6 +10,7 @@
 #include "interrupt.hh"
 
 #include "util/psxutil.hh"
+#include "core/scheduler.hh"
 #include "cpu/cop0.hh"
 #include "imgui/imgui.h"
 
@@ -32,14 +33,20 @@ struct State {
     u32 i_mask = 0;
 } s;
 
+// outside of the state so it survives resets
+Scheduler::EventHandle check_event;
+
 // protos
 void PrettyIReg(u16 reg);
+void checkPending(u32 cycles_late);
+void updatePending();
 } // end private ns
 
 void Init()
 {
     INTERRUPT_INFO("Intializing Interrupts");
     s = {};
+    check_event = Scheduler::Register("Interrupt Check", checkPending);
 }
 
 void Reset()
@@ -48,19 +55,25 @@ void Reset()
     s = {};
 }
 
-void Step()
+void Signal(Type itype)
 {
-    if ((s.i_stat & s.i_mask) != 0) {
-        // raise cop0 int exception
-        Cop0::Exception e = {.type = Cop0::Exception::Type::Interrupt};
-        Cop0::RaiseException(e);
-        // TODO how to reset to avoid spam??
-    }
+    s.i_stat |= (u32)itype;
+    updatePending();
 }
 
-void Signal(Type itype)
+/*
+ * Check for an interrupt to take after the cpu's side changes, like SR being
+ * written or RFE re-enabling interrupts.
+ */
+void Recheck()
 {
-    s.i_stat |= (u32)itype;
+    if (Cop0::InterruptPending()) {
+        if (!Scheduler::IsScheduled(check_event)) {
+            Scheduler::Schedule(check_event, 0);
+        }
+    } else {
+        Scheduler::Cancel(check_event);
+    }
 }
 
 // *** Read ***
@@ -99,6 +112,8 @@ void Write(T data, u32 addr)
     default:
         INTERRUPT_FATAL("Address [{:08x}] not part of interrupt space!", addr);
     }
+    // pending interrupts may have changed, check them before running on
+    updatePending();
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template void Write<u8>(u8 data, u32 addr);
@@ -138,6 +153,30 @@ void OnActive(bool *active)
 }
 
 namespace {
+/*
+ * Take the interrupt if the cpu still wants it. The handler starts with
+ * interrupts off, so it's taken once until it's acknowledged or re-enabled.
+ */
+void checkPending(u32 cycles_late)
+{
+    (void) cycles_late;
+    if (Cop0::InterruptPending()) {
+        // raise cop0 int exception
+        Cop0::Exception e = {.type = Cop0::Exception::Type::Interrupt};
+        Cop0::RaiseException(e);
+    }
+}
+
+/*
+ * Drive the cpu's interrupt line from the unmasked pending interrupts, then
+ * check if it should be taken.
+ */
+void updatePending()
+{
+    Cop0::SetHWIntPending((s.i_stat & s.i_mask) != 0);
+    Recheck();
+}
+
 void PrettyIReg(u16 reg)
 {
     auto pbool = [&](Type t) {
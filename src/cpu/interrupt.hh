@@ -30,8 +30,8 @@ enum Type {
 
 void Init();
 void Reset();
-void Step();
 void Signal(Type itype);
+void Recheck();
 void OnActive(bool *active);
 template<class T> T Read(u32 addr);
 template<class T> void Write(T data, u32 addr);
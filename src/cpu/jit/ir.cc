@@ -0,0 +1,243 @@
+/*
+ * ir.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Optimizing passes for the recompiler. Constant propagation follows values
+ * built with LUI/ORI/ADDIU and friends through the block, which gives known
+ * load/store addresses and lets overflow checks on known operands go away.
+ * A backwards liveness pass then finds register writes that get overwritten
+ * before anything can read them. Anything that can leave the block early
+ * (traps, interpreter fallbacks, memory accesses) counts as reading every
+ * register, so state is always complete whenever the interpreter can see it.
+ */
+
+#include "cpu/jit/ir.hh"
+
+#include "cpu/cpu.hh"
+
+// *** Private Data and Helpers ***
+namespace  {
+using namespace Psx::Cpu;
+using BlockCache::CachedInstr;
+
+constexpr u32 AllRegs = 0xffff'ffff;
+
+// Registers an instruction touches, as bit masks.
+struct RegUse {
+    u32 reads = 0;
+    // always written right away
+    u32 writes = 0;
+    // may change, including later through the load delay slot
+    u32 clobbers = 0;
+    // the register write is the only thing the instruction does
+    bool pure = false;
+    // can leave the block or runs in the interpreter
+    bool barrier = false;
+};
+
+inline u32 bit(u8 r)
+{
+    return 1u << r;
+}
+
+inline u32 signExtend(u16 val)
+{
+    return static_cast<u32>(static_cast<i32>(static_cast<i16>(val)));
+}
+
+inline bool addOverflows(u32 a, u32 b)
+{
+    u32 res = a + b;
+    return ((a ^ res) & (b ^ res)) >> 31;
+}
+
+bool isLoad(BlockCache::OpFunc fn)
+{
+    return fn == Lb || fn == Lbu || fn == Lh || fn == Lhu || fn == Lw || fn == Lwl || fn == Lwr;
+}
+
+bool isStore(BlockCache::OpFunc fn)
+{
+    return fn == Sb || fn == Sh || fn == Sw || fn == Swl || fn == Swr;
+}
+
+RegUse regUse(const CachedInstr& ci, bool no_overflow)
+{
+    const Asm::Instruction& in = ci.instr;
+    const BlockCache::OpFunc fn = ci.fn;
+    RegUse u;
+    if (fn == Addiu || fn == Andi || fn == Ori || fn == Xori || fn == Sltiu || fn == Lui
+     || fn == Addi || fn == Slti) {
+        u.reads = fn == Lui ? 0 : bit(in.rs);
+        u.writes = bit(in.rt);
+        u.pure = (fn != Addi && fn != Slti) || no_overflow;
+    } else if (fn == Addu || fn == Subu || fn == Sltu || fn == And || fn == Or || fn == Xor || fn == Nor
+            || fn == Sllv || fn == Srlv || fn == Srav || fn == Add || fn == Sub || fn == Slt) {
+        u.reads = bit(in.rs) | bit(in.rt);
+        u.writes = bit(in.rd);
+        u.pure = (fn != Add && fn != Sub && fn != Slt) || no_overflow;
+    } else if (fn == Sll || fn == Srl || fn == Sra) {
+        u.reads = bit(in.rt);
+        u.writes = bit(in.rd);
+        u.pure = true;
+    } else if (fn == Mfhi || fn == Mflo) {
+        u.writes = bit(in.rd);
+        u.pure = true;
+    } else if (fn == Mthi || fn == Mtlo) {
+        // the interpreter reads rd here
+        u.reads = bit(in.rd);
+    } else if (fn == Mult || fn == Multu || fn == Div || fn == Divu || fn == Beq || fn == Bne) {
+        u.reads = bit(in.rs) | bit(in.rt);
+    } else if (fn == Blez || fn == Bgtz || fn == Bltz || fn == Bgez || fn == Bltzal || fn == Bgezal) {
+        u.reads = bit(in.rs);
+        // link only happens when the branch is taken
+        u.clobbers = fn == Bltzal || fn == Bgezal ? bit(31) : 0;
+    } else if (fn == J) {
+    } else if (fn == Jal) {
+        u.writes = bit(31);
+    } else if (fn == Jr || fn == Jalr) {
+        u.reads = bit(in.rs);
+        u.clobbers = fn == Jalr ? bit(in.rd) : 0;
+        u.barrier = true;
+    } else if (isLoad(fn) || isStore(fn)) {
+        u.reads = bit(in.rs) | bit(in.rt);
+        u.clobbers = isLoad(fn) ? bit(in.rt) : 0;
+        u.barrier = true;
+    } else {
+        // runs in the interpreter, could do anything
+        u.reads = AllRegs;
+        u.clobbers = AllRegs;
+        u.barrier = true;
+    }
+    if (!u.pure && u.writes != 0 && fn != Jal) {
+        // may trap before writing
+        u.barrier = true;
+    }
+    u.clobbers |= u.writes;
+    return u;
+}
+
+/*
+ * Compute the instruction's result when all its inputs are known. Mirrors the
+ * interpreter, including the ops that trap on overflow (only folded when they
+ * can't).
+ */
+bool evaluate(const CachedInstr& ci, u32 known, const u32 *val, bool no_overflow, u8& dst, u32& out)
+{
+    const Asm::Instruction& in = ci.instr;
+    const BlockCache::OpFunc fn = ci.fn;
+    bool rs = (known & bit(in.rs)) != 0;
+    bool rt = (known & bit(in.rt)) != 0;
+    if (fn == Lui) {
+        dst = in.rt;
+        out = static_cast<u32>(in.imm16) << 16;
+    } else if ((fn == Addiu || fn == Ori || fn == Andi || fn == Xori || (fn == Addi && no_overflow)) && rs) {
+        dst = in.rt;
+        out = fn == Addiu || fn == Addi ? val[in.rs] + signExtend(in.imm16)
+            : fn == Ori ? val[in.rs] | in.imm16
+            : fn == Andi ? val[in.rs] & in.imm16 : val[in.rs] ^ in.imm16;
+    } else if ((fn == Addu || fn == Subu || fn == And || fn == Or || fn == Xor || fn == Nor
+             || (fn == Add && no_overflow) || (fn == Sub && no_overflow)) && rs && rt) {
+        dst = in.rd;
+        out = fn == Addu || fn == Add ? val[in.rs] + val[in.rt]
+            : fn == Subu || fn == Sub ? val[in.rs] - val[in.rt]
+            : fn == And ? val[in.rs] & val[in.rt]
+            : fn == Or ? val[in.rs] | val[in.rt]
+            : fn == Xor ? val[in.rs] ^ val[in.rt] : ~(val[in.rs] | val[in.rt]);
+    } else if ((fn == Sll || fn == Srl || fn == Sra) && rt) {
+        dst = in.rd;
+        out = fn == Sll ? val[in.rt] << in.shamt
+            : fn == Srl ? val[in.rt] >> in.shamt
+            : static_cast<u32>(static_cast<i32>(val[in.rt]) >> in.shamt);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Returns true if the ops that trap on overflow can't with these operands.
+ */
+bool cantOverflow(const CachedInstr& ci, u32 known, const u32 *val)
+{
+    const Asm::Instruction& in = ci.instr;
+    const BlockCache::OpFunc fn = ci.fn;
+    bool rs = (known & bit(in.rs)) != 0;
+    bool rt = (known & bit(in.rt)) != 0;
+    if ((fn == Addi || fn == Slti) && rs) {
+        u32 imm = signExtend(in.imm16);
+        return !addOverflows(val[in.rs], fn == Addi ? imm : 0u - imm);
+    }
+    if ((fn == Add || fn == Sub || fn == Slt) && rs && rt) {
+        return !addOverflows(val[in.rs], fn == Add ? val[in.rt] : 0u - val[in.rt]);
+    }
+    return false;
+}
+
+void propagateConstants(const BlockCache::Block& block, Psx::Cpu::Jit::IrBlock& ir)
+{
+    u32 known = bit(0);
+    u32 val[32] = {};
+    for (size_t i = 0; i < block.instrs.size(); i++) {
+        const CachedInstr& ci = block.instrs[i];
+        Psx::Cpu::Jit::IrInstr& out = ir.instrs[i];
+        if ((isLoad(ci.fn) || isStore(ci.fn)) && (known & bit(ci.instr.rs))) {
+            out.addr_known = true;
+            out.addr = val[ci.instr.rs] + signExtend(ci.instr.imm16);
+        }
+        out.no_overflow = cantOverflow(ci, known, val);
+
+        u8 dst = 0;
+        u32 res = 0;
+        bool folded = evaluate(ci, known, val, out.no_overflow, dst, res);
+        // a load's register is unknown from here on, the only thing that
+        // can stop the delayed write is the next instruction writing it too
+        known &= ~regUse(ci, out.no_overflow).clobbers;
+        if (folded) {
+            out.const_result = true;
+            out.result = res;
+            known |= bit(dst);
+            val[dst] = res;
+        }
+        known |= bit(0);
+        val[0] = 0;
+    }
+}
+
+void eliminateDeadWrites(const BlockCache::Block& block, Psx::Cpu::Jit::IrBlock& ir)
+{
+    // everything is live once the block ends
+    u32 live = AllRegs;
+    for (size_t i = block.instrs.size(); i-- > 0;) {
+        RegUse u = regUse(block.instrs[i], ir.instrs[i].no_overflow);
+        ir.instrs[i].dead_write = u.pure && (u.writes & ~bit(0)) != 0 && (live & u.writes) == 0;
+        if (u.barrier) {
+            live = AllRegs;
+        } else {
+            live = (live & ~u.writes) | u.reads;
+        }
+    }
+}
+}// end namespace
+
+namespace Psx {
+namespace Cpu {
+namespace Jit {
+
+/*
+ * Run the optimizing passes over the block.
+ */
+IrBlock BuildIr(const BlockCache::Block& block)
+{
+    IrBlock ir;
+    ir.instrs.resize(block.instrs.size());
+    propagateConstants(block, ir);
+    eliminateDeadWrites(block, ir);
+    return ir;
+}
+
+}// end namespace
+}
+}
@@ -0,0 +1,43 @@
+/*
+ * ir.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Optimizing passes for the recompiler. The IR is a block's pre-decoded
+ * instructions plus whatever the passes could prove about each of them.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "util/psxutil.hh"
+#include "cpu/blockcache.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace Jit {
+
+struct IrInstr {
+    // load/store address, when the base register holds a known constant
+    bool addr_known = false;
+    u32 addr = 0;
+    // operands are known constants that can't overflow, skip the trap check
+    bool no_overflow = false;
+    // result of the register write is a known constant
+    bool const_result = false;
+    u32 result = 0;
+    // register write gets overwritten before anything can read it
+    bool dead_write = false;
+};
+
+struct IrBlock {
+    std::vector<IrInstr> instrs;
+};
+
+IrBlock BuildIr(const BlockCache::Block& block);
+
+}// end namespace
+}
+}
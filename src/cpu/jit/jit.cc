@@ -0,0 +1,1189 @@
+/*
+ * jit.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Dynamic recompiler for the R3000A. Blocks from the block cache get turned
+ * into x86-64 code that works directly on the CPU register file. Simple ALU,
+ * shift, multiply, load/store and branch ops are emitted inline, everything
+ * else (COP0/COP2, unaligned loads/stores, syscalls, ...) calls back into the
+ * interpreter for that one instruction. Load and branch delay slots live in
+ * the same structs the interpreter uses, so both can hand off to each other
+ * between any two instructions.
+ */
+
+#include "cpu/jit/jit.hh"
+
+#include <cstddef>
+#include <exception>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu/cpu.hh"
+#include "cpu/cop0.hh"
+#include "cpu/jit/ir.hh"
+#include "cpu/jit/x64emitter.hh"
+#include "mem/bus.hh"
+#include "mem/fastmem.hh"
+#include "mem/ram.hh"
+#include "view/imgui/dbgmod.hh"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define PSX_JIT_X64
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+#define JIT_INFO(...) PSXLOG_INFO("JIT", __VA_ARGS__)
+#define JIT_WARN(...) PSXLOG_WARN("JIT", __VA_ARGS__)
+#define JIT_ERROR(...) PSXLOG_ERROR("JIT", __VA_ARGS__)
+
+constexpr size_t CodeBufferSize = 32 * 1024 * 1024;
+// worst case size of a single max length block
+constexpr size_t MaxBlockCodeSize = 64 * 1024;
+
+// *** Private Data and Helpers ***
+namespace  {
+using namespace Psx::Cpu;
+using namespace Psx::Cpu::Jit;
+using BlockCache::Block;
+using BlockCache::CachedInstr;
+
+struct State {
+    u8 *code = nullptr;
+    size_t code_used = 0;
+    u32 epoch = 1;
+    u64 num_compiled = 0;
+    bool optimize = true;
+    OptStats opt_stats;
+
+    // loads/stores go through the fastmem view (see mem/fastmem.hh)
+    bool fastmem = true;
+    // host address of every fastmem access -> its slow path
+    std::unordered_map<uintptr_t, uintptr_t> fastmem_sites;
+    u64 fastmem_faults = 0;
+    u64 fastmem_patches = 0;
+    // set by the last busRead/busWrite when the access got a bus error
+    bool bus_error = false;
+
+    // cpu state the generated code works on. lds and bds are addressed
+    // relative to the register file.
+    Registers *regs = nullptr;
+    i32 lds_off = 0;
+    i32 bds_off = 0;
+
+    // exception thrown by a helper while running generated code, rethrown
+    // once we are back in C++ land
+    std::exception_ptr pending;
+} s;
+
+#ifdef _WIN32
+constexpr Reg Arg0 = Reg::Rcx;
+constexpr Reg Arg1 = Reg::Rdx;
+constexpr u8 ShadowSpace = 32;
+#else
+constexpr Reg Arg0 = Reg::Rdi;
+constexpr Reg Arg1 = Reg::Rsi;
+constexpr u8 ShadowSpace = 0;
+#endif
+
+// *** Helpers called from generated code ***
+// C++ exceptions can't unwind through generated code, so catch them here and
+// drop the block cache. The generation check after the call then bails out
+// of the block.
+void fault()
+{
+    s.pending = std::current_exception();
+    BlockCache::Clear();
+}
+
+void stepHelper(const CachedInstr *ci)
+{
+    try {
+        // copy, the instruction may invalidate its own block
+        CachedInstr copy = *ci;
+        StepInstr(copy.fn, copy.instr);
+    } catch (...) {
+        fault();
+    }
+}
+
+// accesses that get a bus error are left to the interpreter, which raises
+// it, see emitBusErrorCheck
+template<class T>
+T busRead(u32 addr)
+{
+    s.bus_error = Psx::Bus::IsBusError(addr);
+    if (s.bus_error) {
+        return 0;
+    }
+    try {
+        return Psx::Bus::Read<T>(addr);
+    } catch (...) {
+        fault();
+        return 0;
+    }
+}
+
+template<class T>
+void busWrite(u32 data, u32 addr)
+{
+    s.bus_error = Psx::Bus::IsBusError(addr);
+    if (s.bus_error) {
+        return;
+    }
+    try {
+        Psx::Bus::Write<T>(static_cast<T>(data), addr);
+    } catch (...) {
+        fault();
+    }
+}
+
+// stores to an address known to be in RAM, which can't get a bus error. Only
+// go through the bus while the cache is isolated.
+template<class T>
+void ramWrite(u32 data, u32 addr)
+{
+    if (Psx::Cop0::CacheIsIsolated()) {
+        busWrite<T>(data, addr);
+        return;
+    }
+#ifdef PSX_DEBUG
+    using namespace Psx::View::ImGuiLayer::DbgMod;
+    Breakpoints::Saw<Breakpoints::BrkType::WriteWatch>(addr);
+#endif
+    Psx::Ram::Write<T>(static_cast<T>(data), addr);
+}
+
+inline u32 signExtend(u16 val)
+{
+    return static_cast<u32>(static_cast<i32>(static_cast<i16>(val)));
+}
+
+bool isLoad(BlockCache::OpFunc fn)
+{
+    return fn == Lb || fn == Lbu || fn == Lh || fn == Lhu || fn == Lw || fn == Lwl || fn == Lwr;
+}
+
+bool isStore(BlockCache::OpFunc fn)
+{
+    return fn == Sb || fn == Sh || fn == Sw;
+}
+
+/*
+ * Returns true if the address is in main RAM (or one of its mirrors) through
+ * kuseg, kseg0 or kseg1.
+ */
+bool isRamAddr(u32 addr)
+{
+    u32 seg = addr >> 29;
+    return (seg == 0 || seg == 4 || seg == 5) && (addr & 0x1fff'ffff) < 0x0080'0000;
+}
+
+bool isBranch(BlockCache::OpFunc fn)
+{
+    return fn == J || fn == Jal || fn == Jr || fn == Jalr
+        || fn == Beq || fn == Bne || fn == Blez || fn == Bgtz
+        || fn == Bltz || fn == Bgez || fn == Bltzal || fn == Bgezal;
+}
+
+/*
+ * Returns true if the recompiler emits the op itself instead of calling back
+ * into the interpreter.
+ */
+bool isInline(BlockCache::OpFunc fn)
+{
+    static const BlockCache::OpFunc inline_ops[] = {
+        Addi, Addiu, Slti, Sltiu, Andi, Ori, Xori, Lui,
+        Add, Addu, Sub, Subu, Slt, Sltu, And, Or, Xor, Nor,
+        Sll, Srl, Sra, Sllv, Srlv, Srav,
+        Mult, Multu, Div, Divu, Mfhi, Mflo, Mthi, Mtlo,
+        Lb, Lbu, Lh, Lhu, Lw, Sb, Sh, Sw,
+        J, Jal, Jr, Jalr, Beq, Bne, Blez, Bgtz, Bltz, Bgez, Bltzal, Bgezal,
+    };
+    for (auto op : inline_ops) {
+        if (fn == op) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// *** Memory operands (rbx holds the register file) ***
+Mem gpr(u8 r)
+{
+    return Ptr(Reg::Rbx, static_cast<i32>(offsetof(Registers, r) + 4 * r));
+}
+
+Mem pcMem() { return Ptr(Reg::Rbx, offsetof(Registers, pc)); }
+Mem hiMem() { return Ptr(Reg::Rbx, offsetof(Registers, hi)); }
+Mem loMem() { return Ptr(Reg::Rbx, offsetof(Registers, lo)); }
+
+Mem ldsReg() { return Ptr(Reg::Rbx, s.lds_off + static_cast<i32>(offsetof(LoadDelaySlot, reg))); }
+Mem ldsVal() { return Ptr(Reg::Rbx, s.lds_off + static_cast<i32>(offsetof(LoadDelaySlot, val))); }
+Mem ldsPrimed() { return Ptr(Reg::Rbx, s.lds_off + static_cast<i32>(offsetof(LoadDelaySlot, is_primed))); }
+
+Mem bdsPrimed() { return Ptr(Reg::Rbx, s.bds_off + static_cast<i32>(offsetof(BranchDelaySlot, is_primed))); }
+Mem bdsTake() { return Ptr(Reg::Rbx, s.bds_off + static_cast<i32>(offsetof(BranchDelaySlot, take_branch))); }
+Mem bdsPc() { return Ptr(Reg::Rbx, s.bds_off + static_cast<i32>(offsetof(BranchDelaySlot, pc))); }
+
+/*
+ * Compiles a single block. Register usage in the generated code:
+ *   rbx - register file
+ *   rbp - block cache generation at block entry
+ *   r12/r13 - latched branch delay (take_branch, target)
+ *   r14/r15 - latched load delay (reg, value)
+ *   rax/rcx/arg regs - scratch
+ */
+class BlockCompiler {
+public:
+    BlockCompiler(X64Emitter& emit, const Block& block, const IrBlock& ir)
+        : m_e(emit), m_block(block), m_ir(ir) {}
+
+    void Compile();
+
+private:
+    enum class StubType {
+        Exit,  // leave the block
+        Slow,  // run the instruction in the interpreter then leave
+        Dirty, // block entered with delay slots pending, interpret first instr
+    };
+    struct Stub {
+        StubType type;
+        size_t rel;
+        u32 index;
+        bool set_pc;
+        u32 pc;
+    };
+    // load/store through the fastmem view, which needs a slow path for
+    // when it faults
+    struct FastmemAccess {
+        size_t site;
+        size_t resume;
+        u32 index;
+    };
+
+    void emitInstr();
+    void emitInline(const CachedInstr& ci);
+    void emitFallback(const CachedInstr& ci);
+    bool emitOptimized(const CachedInstr& ci);
+    void emitDirectLoad(const CachedInstr& ci, u32 size);
+    void emitDirectStore(const CachedInstr& ci, u32 size);
+    void emitFastmemAccess(const CachedInstr& ci, u32 size);
+
+    void prefix();
+    void suffix(u8 mod, bool is_load, u8 load_reg);
+    void storeGpr(u8 r, Reg src);
+    void callHelper(const void *fn);
+    void emitBranch(Cond not_taken, u32 target, bool link);
+    void emitGenCheck(bool set_pc, u32 pc);
+    void emitStubs();
+    void emitFastmemStubs();
+    void emitBusErrorCheck(u32 index);
+
+    void exitOn(Cond cc, bool set_pc, u32 pc)
+    {
+        m_stubs.push_back({StubType::Exit, m_e.Jcc(cc), m_i + 1, set_pc, pc});
+    }
+    void slowOn(Cond cc)
+    {
+        m_stubs.push_back({StubType::Slow, m_e.Jcc(cc), m_i, false, 0});
+    }
+
+    X64Emitter& m_e;
+    const Block& m_block;
+    // empty when not optimizing
+    const IrBlock& m_ir;
+    std::vector<Stub> m_stubs;
+    std::vector<FastmemAccess> m_fastmem;
+    size_t m_epilogue = 0;
+    size_t m_resume = 0;
+
+    // current instruction
+    u32 m_i = 0;
+    u32 m_addr = 0;
+    bool m_last = false;
+    bool m_prev_load = false;
+    bool m_delay_slot = false;
+    IrInstr m_opt;
+    // register the previous instruction loaded into
+    u8 m_prev_rt = 0;
+};
+
+void BlockCompiler::Compile()
+{
+    // prologue
+    m_e.Push(Reg::Rbp);
+    m_e.Push(Reg::Rbx);
+    m_e.Push(Reg::R12);
+    m_e.Push(Reg::R13);
+    m_e.Push(Reg::R14);
+    m_e.Push(Reg::R15);
+    m_e.SubRspI(8 + ShadowSpace);
+    m_e.MovRPtr(Reg::Rbx, s.regs);
+    m_e.MovRPtr(Reg::Rax, BlockCache::GenerationPtr());
+    m_e.MovRM64(Reg::Rbp, Ptr(Reg::Rax));
+
+    u32 n = static_cast<u32>(m_block.instrs.size());
+    for (m_i = 0; m_i < n; m_i++) {
+        m_addr = m_block.pc + 4 * m_i;
+        m_last = m_i == n - 1;
+        m_prev_load = m_i > 0 && isLoad(m_block.instrs[m_i - 1].fn);
+        m_delay_slot = m_i > 0 && isBranch(m_block.instrs[m_i - 1].fn);
+        m_prev_rt = m_prev_load ? m_block.instrs[m_i - 1].instr.rt : 0;
+        m_opt = m_ir.instrs.empty() ? IrInstr{} : m_ir.instrs[m_i];
+        emitInstr();
+        if (m_i == 0) {
+            m_resume = m_e.Pos();
+        }
+    }
+    m_e.MovRI(Reg::Rax, n);
+
+    // epilogue
+    m_epilogue = m_e.Pos();
+    m_e.AddRspI(8 + ShadowSpace);
+    m_e.Pop(Reg::R15);
+    m_e.Pop(Reg::R14);
+    m_e.Pop(Reg::R13);
+    m_e.Pop(Reg::R12);
+    m_e.Pop(Reg::Rbx);
+    m_e.Pop(Reg::Rbp);
+    m_e.Ret();
+
+    // fastmem stubs can add slow paths
+    emitFastmemStubs();
+    emitStubs();
+}
+
+void BlockCompiler::emitInstr()
+{
+    const CachedInstr& ci = m_block.instrs[m_i];
+    if (!isInline(ci.fn)) {
+        emitFallback(ci);
+        return;
+    }
+
+    if (m_i == 0) {
+        // generated code assumes no delay slots are pending on entry
+        m_e.MovRM8(Reg::Rax, ldsPrimed());
+        m_e.AluRM8(AluOp::Or, Reg::Rax, bdsPrimed());
+        m_e.AluRM8(AluOp::Or, Reg::Rax, bdsTake());
+        m_stubs.push_back({StubType::Dirty, m_e.Jcc(Cond::NE), 0, false, 0});
+    }
+
+    bool direct_mem = emitOptimized(ci);
+    if (!direct_mem) {
+        emitInline(ci);
+    }
+
+    if (m_last) {
+        if (!m_delay_slot) {
+            m_e.MovMI(pcMem(), m_addr + 4);
+        }
+        return;
+    }
+    if (isStore(ci.fn) || (isLoad(ci.fn) && !direct_mem)) {
+        // stores can invalidate this block, and both can fault
+        emitGenCheck(true, m_addr + 4);
+    }
+}
+
+/*
+ * Use what the optimizing passes found to emit a cheaper version of the
+ * instruction. Returns false if there was nothing to improve on, or true if
+ * the instruction was fully emitted.
+ */
+bool BlockCompiler::emitOptimized(const CachedInstr& ci)
+{
+    const Asm::Instruction& in = ci.instr;
+    const BlockCache::OpFunc fn = ci.fn;
+    if (m_opt.dead_write || m_opt.const_result) {
+        // register-type ops all live under the special opcode
+        u8 dst = in.op == 0 ? in.rd : in.rt;
+        prefix();
+        if (m_opt.dead_write) {
+            s.opt_stats.dead_writes++;
+        } else {
+            if (dst != 0) {
+                m_e.MovMI(gpr(dst), m_opt.result);
+            }
+            s.opt_stats.const_folds++;
+        }
+        // mirrors the interpreter, which reports no modified register here
+        suffix(fn == Mfhi || fn == Mflo ? 0 : dst, false, 0);
+        return true;
+    }
+    if (m_opt.addr_known && isRamAddr(m_opt.addr) && (isLoad(fn) || isStore(fn))) {
+        u32 size = fn == Lb || fn == Lbu || fn == Sb ? 1 : fn == Lh || fn == Lhu || fn == Sh ? 2 : 4;
+        // unaligned accesses always trap, leave those to the normal path
+        if ((m_opt.addr & (size - 1)) == 0 && isInline(fn)) {
+            if (isLoad(fn)) {
+                emitDirectLoad(ci, size);
+            } else {
+                emitDirectStore(ci, size);
+            }
+            s.opt_stats.direct_mem++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Load from a known RAM address straight out of host memory. Nothing can
+ * fault or invalidate code here, so no generation check is needed after.
+ */
+void BlockCompiler::emitDirectLoad(const CachedInstr& ci, u32 size)
+{
+    const BlockCache::OpFunc fn = ci.fn;
+    prefix();
+    m_e.MovRPtr(Reg::Rax, Psx::Ram::HostPtr() + (m_opt.addr & 0x1f'ffff));
+    if (size == 1) {
+        m_e.MovzxRM8(Reg::Rax, Ptr(Reg::Rax));
+        if (fn == Lb) {
+            m_e.MovsxRR8(Reg::Rax, Reg::Rax);
+        }
+    } else if (size == 2) {
+        m_e.MovzxRM16(Reg::Rax, Ptr(Reg::Rax));
+        if (fn == Lh) {
+            m_e.MovsxRR16(Reg::Rax, Reg::Rax);
+        }
+    } else {
+        m_e.MovRM(Reg::Rax, Ptr(Reg::Rax));
+    }
+    m_e.MovMR(ldsVal(), Reg::Rax);
+    m_e.MovMI8(ldsReg(), ci.instr.rt);
+    m_e.MovMI8(ldsPrimed(), 1);
+    suffix(0, true, ci.instr.rt);
+}
+
+/*
+ * Store to a known RAM address, skipping the address and alignment checks
+ * and the bus dispatch. Ram::Write still invalidates any code in the page.
+ */
+void BlockCompiler::emitDirectStore(const CachedInstr& ci, u32 size)
+{
+    prefix();
+    m_e.MovRI(Arg1, m_opt.addr);
+    m_e.MovRM(Arg0, gpr(ci.instr.rt));
+    if (size == 1) {
+        callHelper(reinterpret_cast<const void*>(&ramWrite<u8>));
+    } else if (size == 2) {
+        callHelper(reinterpret_cast<const void*>(&ramWrite<u16>));
+    } else {
+        callHelper(reinterpret_cast<const void*>(&ramWrite<u32>));
+    }
+    suffix(0, false, 0);
+}
+
+/*
+ * Hand a single instruction to the interpreter.
+ */
+void BlockCompiler::emitFallback(const CachedInstr& ci)
+{
+    m_e.MovMI(pcMem(), m_addr);
+    m_e.MovRPtr(Arg0, &ci);
+    callHelper(reinterpret_cast<const void*>(&stepHelper));
+    if (m_last) {
+        return;
+    }
+    // exceptions and cop0 writes change the pc
+    m_e.AluMI(AluOp::Cmp, pcMem(), m_addr + 4);
+    exitOn(Cond::NE, false, 0);
+    emitGenCheck(false, 0);
+}
+
+/*
+ * Emit the instruction inline. Any check that can trap (overflow, alignment)
+ * happens before touching cpu state so the slow path can just re-run the
+ * instruction in the interpreter.
+ */
+void BlockCompiler::emitInline(const CachedInstr& ci)
+{
+    const Asm::Instruction& in = ci.instr;
+    const BlockCache::OpFunc fn = ci.fn;
+    const u32 simm = signExtend(in.imm16);
+    u8 mod = 0;
+    bool is_load = false;
+
+    // *** ALU Immediate ***
+    if (fn == Addi) {
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.AluRI(AluOp::Add, Reg::Rax, simm);
+        if (!m_opt.no_overflow) {
+            slowOn(Cond::O);
+        }
+        prefix();
+        storeGpr(in.rt, Reg::Rax);
+        mod = in.rt;
+    } else if (fn == Addiu || fn == Andi || fn == Ori || fn == Xori) {
+        prefix();
+        if (in.rt != 0) {
+            m_e.MovRM(Reg::Rax, gpr(in.rs));
+            if (fn == Addiu) {
+                m_e.AluRI(AluOp::Add, Reg::Rax, simm);
+            } else {
+                AluOp op = fn == Andi ? AluOp::And : fn == Ori ? AluOp::Or : AluOp::Xor;
+                m_e.AluRI(op, Reg::Rax, in.imm16);
+            }
+            storeGpr(in.rt, Reg::Rax);
+        }
+        mod = in.rt;
+    } else if (fn == Slti || fn == Sltiu) {
+        // signed compare by subtracting, same as the interpreter
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.AluRI(AluOp::Add, Reg::Rax, ~simm + 1);
+        if (fn == Slti && !m_opt.no_overflow) {
+            slowOn(Cond::O);
+        }
+        prefix();
+        m_e.ShiftRI(ShiftOp::Shr, Reg::Rax, 31);
+        storeGpr(in.rt, Reg::Rax);
+        mod = in.rt;
+    } else if (fn == Lui) {
+        prefix();
+        if (in.rt != 0) {
+            m_e.MovMI(gpr(in.rt), static_cast<u32>(in.imm16) << 16);
+        }
+        mod = in.rt;
+
+    // *** Three Operand Register-Type ***
+    } else if (fn == Add || fn == Sub || fn == Slt) {
+        m_e.MovRM(Reg::Rcx, gpr(in.rt));
+        if (fn != Add) {
+            m_e.Neg(Reg::Rcx);
+        }
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.AluRR(AluOp::Add, Reg::Rax, Reg::Rcx);
+        if (!m_opt.no_overflow) {
+            slowOn(Cond::O);
+        }
+        prefix();
+        if (fn == Slt) {
+            m_e.ShiftRI(ShiftOp::Shr, Reg::Rax, 31);
+        }
+        storeGpr(in.rd, Reg::Rax);
+        mod = in.rd;
+    } else if (fn == Addu || fn == Subu || fn == Sltu || fn == And || fn == Or || fn == Xor || fn == Nor) {
+        prefix();
+        if (in.rd != 0) {
+            AluOp op = fn == Addu ? AluOp::Add
+                     : fn == Subu || fn == Sltu ? AluOp::Sub
+                     : fn == And ? AluOp::And
+                     : fn == Xor ? AluOp::Xor : AluOp::Or;
+            m_e.MovRM(Reg::Rax, gpr(in.rs));
+            m_e.AluRM(op, Reg::Rax, gpr(in.rt));
+            if (fn == Sltu) {
+                m_e.ShiftRI(ShiftOp::Shr, Reg::Rax, 31);
+            } else if (fn == Nor) {
+                m_e.Not(Reg::Rax);
+            }
+            storeGpr(in.rd, Reg::Rax);
+        }
+        mod = in.rd;
+
+    // *** Shifts ***
+    } else if (fn == Sll || fn == Srl || fn == Sra) {
+        prefix();
+        if (in.rd != 0) {
+            ShiftOp op = fn == Sll ? ShiftOp::Shl : fn == Srl ? ShiftOp::Shr : ShiftOp::Sar;
+            m_e.MovRM(Reg::Rax, gpr(in.rt));
+            if (in.shamt != 0) {
+                m_e.ShiftRI(op, Reg::Rax, in.shamt);
+            }
+            storeGpr(in.rd, Reg::Rax);
+        }
+        mod = in.rd;
+    } else if (fn == Sllv || fn == Srlv || fn == Srav) {
+        prefix();
+        if (in.rd != 0) {
+            // x86 masks the shift amount to 5 bits just like the R3000A
+            ShiftOp op = fn == Sllv ? ShiftOp::Shl : fn == Srlv ? ShiftOp::Shr : ShiftOp::Sar;
+            m_e.MovRM(Reg::Rcx, gpr(in.rs));
+            m_e.MovRM(Reg::Rax, gpr(in.rt));
+            m_e.ShiftRCl(op, Reg::Rax);
+            storeGpr(in.rd, Reg::Rax);
+        }
+        mod = in.rd;
+
+    // *** Multiply and Divide ***
+    } else if (fn == Mult || fn == Multu) {
+        prefix();
+        if (fn == Mult) {
+            m_e.MovsxdRM(Reg::Rax, gpr(in.rs));
+            m_e.MovsxdRM(Reg::Rcx, gpr(in.rt));
+        } else {
+            m_e.MovRM(Reg::Rax, gpr(in.rs));
+            m_e.MovRM(Reg::Rcx, gpr(in.rt));
+        }
+        m_e.ImulRR64(Reg::Rax, Reg::Rcx);
+        m_e.MovMR(loMem(), Reg::Rax);
+        m_e.ShiftRI64(ShiftOp::Shr, Reg::Rax, 32);
+        m_e.MovMR(hiMem(), Reg::Rax);
+    } else if (fn == Div || fn == Divu) {
+        // all the special cases make this not worth inlining
+        prefix();
+        m_e.MovRPtr(Arg0, &ci.instr);
+        callHelper(reinterpret_cast<const void*>(fn));
+    } else if (fn == Mfhi || fn == Mflo) {
+        // mirrors the interpreter, which reports no modified register here
+        prefix();
+        if (in.rd != 0) {
+            m_e.MovRM(Reg::Rax, fn == Mfhi ? hiMem() : loMem());
+            storeGpr(in.rd, Reg::Rax);
+        }
+    } else if (fn == Mthi || fn == Mtlo) {
+        prefix();
+        m_e.MovRM(Reg::Rax, gpr(in.rd));
+        m_e.MovMR(fn == Mthi ? hiMem() : loMem(), Reg::Rax);
+
+    // *** Loads and Stores ***
+    } else if (isLoad(fn) || isStore(fn)) {
+        u32 size = fn == Lb || fn == Lbu || fn == Sb ? 1 : fn == Lh || fn == Lhu || fn == Sh ? 2 : 4;
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.AluRI(AluOp::Add, Reg::Rax, simm);
+        if (size > 1) {
+            m_e.TestRI(Reg::Rax, size - 1);
+            slowOn(Cond::NE);
+        }
+        // the access comes before prefix so a bus error can still go to the
+        // slow path
+        if (s.fastmem && Psx::Fastmem::IsEnabled()) {
+            emitFastmemAccess(ci, size);
+            is_load = isLoad(fn);
+        } else if (isLoad(fn)) {
+            m_e.MovRR(Arg0, Reg::Rax);
+            if (size == 1) {
+                callHelper(reinterpret_cast<const void*>(&busRead<u8>));
+                if (fn == Lb) {
+                    m_e.MovsxRR8(Reg::Rax, Reg::Rax);
+                } else {
+                    m_e.MovzxRR8(Reg::Rax, Reg::Rax);
+                }
+            } else if (size == 2) {
+                callHelper(reinterpret_cast<const void*>(&busRead<u16>));
+                if (fn == Lh) {
+                    m_e.MovsxRR16(Reg::Rax, Reg::Rax);
+                } else {
+                    m_e.MovzxRR16(Reg::Rax, Reg::Rax);
+                }
+            } else {
+                callHelper(reinterpret_cast<const void*>(&busRead<u32>));
+            }
+            emitBusErrorCheck(m_i);
+            prefix();
+            m_e.MovMR(ldsVal(), Reg::Rax);
+            m_e.MovMI8(ldsReg(), in.rt);
+            m_e.MovMI8(ldsPrimed(), 1);
+            is_load = true;
+        } else {
+            m_e.MovRR(Arg1, Reg::Rax);
+            m_e.MovRM(Arg0, gpr(in.rt));
+            if (size == 1) {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u8>));
+            } else if (size == 2) {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u16>));
+            } else {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u32>));
+            }
+            emitBusErrorCheck(m_i);
+            prefix();
+        }
+
+    // *** Jumps and Branches ***
+    } else if (fn == J || fn == Jal) {
+        prefix();
+        u32 target = (in.target << 2) | ((m_addr + 4) & 0xf000'0000);
+        if (fn == Jal) {
+            m_e.MovMI(gpr(31), m_addr + 8);
+            mod = 31;
+        }
+        m_e.MovMI(bdsPc(), target);
+        m_e.MovMI8(bdsTake(), 1);
+        m_e.MovMI8(bdsPrimed(), 1);
+    } else if (fn == Jr || fn == Jalr) {
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.TestRI(Reg::Rax, 0x3);
+        slowOn(Cond::NE);
+        prefix();
+        m_e.MovMR(bdsPc(), Reg::Rax);
+        if (fn == Jalr && in.rd != 0) {
+            m_e.MovMI(gpr(in.rd), m_addr + 8);
+        }
+        m_e.MovMI8(bdsTake(), 1);
+        m_e.MovMI8(bdsPrimed(), 1);
+    } else if (fn == Beq || fn == Bne) {
+        prefix();
+        m_e.MovRM(Reg::Rax, gpr(in.rs));
+        m_e.AluRM(AluOp::Cmp, Reg::Rax, gpr(in.rt));
+        emitBranch(fn == Beq ? Cond::NE : Cond::E, m_addr + 4 + (simm << 2), false);
+    } else {
+        // compare against zero
+        prefix();
+        m_e.AluMI(AluOp::Cmp, gpr(in.rs), 0);
+        Cond not_taken = fn == Blez ? Cond::G
+                       : fn == Bgtz ? Cond::LE
+                       : fn == Bltz || fn == Bltzal ? Cond::GE : Cond::L;
+        emitBranch(not_taken, m_addr + 4 + (simm << 2), fn == Bltzal || fn == Bgezal);
+    }
+
+    suffix(mod, is_load, in.rt);
+}
+
+/*
+ * Load/store with the guest address in eax as a single host access through
+ * the fastmem view. Anything that isn't plain RAM or scratchpad faults, and
+ * the fault handler sends it to the slow path emitted in emitFastmemStubs.
+ */
+void BlockCompiler::emitFastmemAccess(const CachedInstr& ci, u32 size)
+{
+    const BlockCache::OpFunc fn = ci.fn;
+    if (isStore(fn)) {
+        m_e.MovRM(Reg::Rdx, gpr(ci.instr.rt));
+    }
+    m_e.MovRPtr(Reg::Rcx, Psx::Fastmem::Base());
+    size_t site = m_e.Pos();
+    Mem host = Ptr(Reg::Rcx, Reg::Rax, 1, 0);
+    if (isLoad(fn)) {
+        if (size == 1) {
+            m_e.MovzxRM8(Reg::Rax, host);
+        } else if (size == 2) {
+            m_e.MovzxRM16(Reg::Rax, host);
+        } else {
+            m_e.MovRM(Reg::Rax, host);
+        }
+    } else {
+        if (size == 1) {
+            m_e.MovMR8(host, Reg::Rdx);
+        } else if (size == 2) {
+            m_e.MovMR16(host, Reg::Rdx);
+        } else {
+            m_e.MovMR(host, Reg::Rdx);
+        }
+    }
+    // leave room to patch in a jump to the slow path
+    while (m_e.Pos() < site + X64Emitter::JmpSize) {
+        m_e.Nop();
+    }
+    if (fn == Lb) {
+        m_e.MovsxRR8(Reg::Rax, Reg::Rax);
+    } else if (fn == Lh) {
+        m_e.MovsxRR16(Reg::Rax, Reg::Rax);
+    }
+    m_fastmem.push_back({site, m_e.Pos(), m_i});
+
+    prefix();
+    if (isLoad(fn)) {
+        m_e.MovMR(ldsVal(), Reg::Rax);
+        m_e.MovMI8(ldsReg(), ci.instr.rt);
+        m_e.MovMI8(ldsPrimed(), 1);
+    }
+}
+
+/*
+ * Branch bookkeeping done before the instruction runs, see StepInstr.
+ */
+void BlockCompiler::prefix()
+{
+    if (m_delay_slot) {
+        m_e.MovzxRM8(Reg::R12, bdsTake());
+        m_e.MovRM(Reg::R13, bdsPc());
+        m_e.MovMI8(bdsTake(), 0);
+        m_e.MovMI8(bdsPrimed(), 0);
+    }
+    if (m_prev_load) {
+        if (m_ir.instrs.empty()) {
+            m_e.MovzxRM8(Reg::R14, ldsReg());
+        }
+        m_e.MovRM(Reg::R15, ldsVal());
+        m_e.MovMI8(ldsPrimed(), 0);
+    }
+}
+
+/*
+ * Bookkeeping done after the instruction runs: retire the previous load
+ * (unless this instruction wrote the same register) and take the branch if
+ * this was a delay slot.
+ */
+void BlockCompiler::suffix(u8 mod, bool is_load, u8 load_reg)
+{
+    if (m_prev_load && !m_ir.instrs.empty()) {
+        // the previous instruction's register is known here, so the compare
+        // happens now and r0 never gets written
+        u8 reg = is_load ? load_reg : mod;
+        bool commit = is_load ? reg != 0 : reg != m_prev_rt;
+        if (commit && m_prev_rt != 0) {
+            m_e.MovMR(gpr(m_prev_rt), Reg::R15);
+        }
+    } else if (m_prev_load) {
+        // a new load replaced lds.reg, compare against that instead
+        u8 reg = is_load ? load_reg : mod;
+        if (is_load && reg != 0) {
+            m_e.MovMR(Ptr(Reg::Rbx, Reg::R14, 4, offsetof(Registers, r)), Reg::R15);
+        } else if (!is_load) {
+            m_e.AluRI(AluOp::Cmp, Reg::R14, reg);
+            size_t skip = m_e.Jcc(Cond::E);
+            m_e.MovMR(Ptr(Reg::Rbx, Reg::R14, 4, offsetof(Registers, r)), Reg::R15);
+            m_e.Bind(skip);
+        }
+        m_e.MovMI(gpr(0), 0);
+    }
+    if (m_delay_slot) {
+        m_e.MovMI(pcMem(), m_addr + 4);
+        m_e.TestRR(Reg::R12, Reg::R12);
+        size_t skip = m_e.Jcc(Cond::E);
+        m_e.MovMR(pcMem(), Reg::R13);
+        m_e.Bind(skip);
+    }
+}
+
+void BlockCompiler::storeGpr(u8 r, Reg src)
+{
+    if (r != 0) {
+        m_e.MovMR(gpr(r), src);
+    }
+}
+
+void BlockCompiler::callHelper(const void *fn)
+{
+    m_e.MovRPtr(Reg::Rax, fn);
+    m_e.CallR(Reg::Rax);
+}
+
+/*
+ * Flags must already be set by a compare. Falls through to the taken path
+ * unless not_taken holds.
+ */
+void BlockCompiler::emitBranch(Cond not_taken, u32 target, bool link)
+{
+    size_t skip = m_e.Jcc(not_taken);
+    m_e.MovMI8(bdsTake(), 1);
+    m_e.MovMI(bdsPc(), target);
+    if (link) {
+        m_e.MovMI(gpr(31), m_addr + 12);
+    }
+    m_e.Bind(skip);
+    m_e.MovMI8(bdsPrimed(), 1);
+}
+
+/*
+ * After a busRead/busWrite: run the instruction again in the interpreter if
+ * the access got a bus error, so it raises the exception. Nothing of the
+ * instruction may have been done yet (prefix included).
+ */
+void BlockCompiler::emitBusErrorCheck(u32 index)
+{
+    m_e.MovRPtr(Reg::Rcx, &s.bus_error);
+    m_e.MovzxRM8(Reg::Rcx, Ptr(Reg::Rcx));
+    m_e.TestRR(Reg::Rcx, Reg::Rcx);
+    m_stubs.push_back({StubType::Slow, m_e.Jcc(Cond::NE), index, false, 0});
+}
+
+/*
+ * Leave the block if anything got dropped from the block cache.
+ */
+void BlockCompiler::emitGenCheck(bool set_pc, u32 pc)
+{
+    m_e.MovRPtr(Reg::Rax, BlockCache::GenerationPtr());
+    m_e.CmpMR64(Ptr(Reg::Rax), Reg::Rbp);
+    exitOn(Cond::NE, set_pc, pc);
+}
+
+void BlockCompiler::emitStubs()
+{
+    u32 n = static_cast<u32>(m_block.instrs.size());
+    for (const Stub& stub : m_stubs) {
+        m_e.Bind(stub.rel);
+        u32 addr = m_block.pc + 4 * stub.index;
+        switch (stub.type) {
+        case StubType::Exit:
+            if (stub.set_pc) {
+                m_e.MovMI(pcMem(), stub.pc);
+            }
+            m_e.MovRI(Reg::Rax, stub.index);
+            m_e.JmpTo(m_epilogue);
+            break;
+        case StubType::Slow:
+            m_e.MovMI(pcMem(), addr);
+            m_e.MovRPtr(Arg0, &m_block.instrs[stub.index]);
+            callHelper(reinterpret_cast<const void*>(&stepHelper));
+            m_e.MovRI(Reg::Rax, stub.index + 1);
+            m_e.JmpTo(m_epilogue);
+            break;
+        case StubType::Dirty:
+            m_e.MovMI(pcMem(), addr);
+            m_e.MovRPtr(Arg0, &m_block.instrs[0]);
+            callHelper(reinterpret_cast<const void*>(&stepHelper));
+            if (n > 1) {
+                // carry on with the rest of the block if nothing changed
+                m_e.AluMI(AluOp::Cmp, pcMem(), addr + 4);
+                size_t pc_changed = m_e.Jcc(Cond::NE);
+                m_e.MovRPtr(Reg::Rax, BlockCache::GenerationPtr());
+                m_e.CmpMR64(Ptr(Reg::Rax), Reg::Rbp);
+                size_t gen_changed = m_e.Jcc(Cond::NE);
+                m_e.JmpTo(m_resume);
+                m_e.Bind(pc_changed);
+                m_e.Bind(gen_changed);
+            }
+            m_e.MovRI(Reg::Rax, 1);
+            m_e.JmpTo(m_epilogue);
+            break;
+        }
+    }
+}
+/*
+ * Slow paths for fastmem accesses. Registers are the same as at the fault:
+ * eax holds the guest address and edx the data to store.
+ */
+void BlockCompiler::emitFastmemStubs()
+{
+    for (const FastmemAccess& access : m_fastmem) {
+        size_t stub = m_e.Pos();
+        const BlockCache::OpFunc fn = m_block.instrs[access.index].fn;
+        if (isLoad(fn)) {
+            m_e.MovRR(Arg0, Reg::Rax);
+            if (fn == Lb || fn == Lbu) {
+                callHelper(reinterpret_cast<const void*>(&busRead<u8>));
+                if (fn == Lb) {
+                    m_e.MovsxRR8(Reg::Rax, Reg::Rax);
+                } else {
+                    m_e.MovzxRR8(Reg::Rax, Reg::Rax);
+                }
+            } else if (fn == Lh || fn == Lhu) {
+                callHelper(reinterpret_cast<const void*>(&busRead<u16>));
+                if (fn == Lh) {
+                    m_e.MovsxRR16(Reg::Rax, Reg::Rax);
+                } else {
+                    m_e.MovzxRR16(Reg::Rax, Reg::Rax);
+                }
+            } else {
+                callHelper(reinterpret_cast<const void*>(&busRead<u32>));
+            }
+        } else {
+            m_e.MovRR(Arg0, Reg::Rdx);
+            m_e.MovRR(Arg1, Reg::Rax);
+            if (fn == Sb) {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u8>));
+            } else if (fn == Sh) {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u16>));
+            } else {
+                callHelper(reinterpret_cast<const void*>(&busWrite<u32>));
+            }
+        }
+        emitBusErrorCheck(access.index);
+        m_e.JmpTo(access.resume);
+        if (!m_e.Overflowed()) {
+            auto host = [this] (size_t pos) { return reinterpret_cast<uintptr_t>(m_e.Start() + pos); };
+            s.fastmem_sites[host(access.site)] = host(stub);
+        }
+    }
+}
+
+/*
+ * Called from the SIGSEGV handler when recompiled code faults in the
+ * fastmem view. RAM and the scratchpad only fault while they're write
+ * protected (code pages, dirty tracking, isolated cache), so those just take
+ * the slow path this once. Anything else
+ * will always fault, so the access gets patched to jump to the slow path
+ * directly.
+ */
+bool handleFastmemFault(uintptr_t& pc, u32 guest_addr)
+{
+    auto iter = s.fastmem_sites.find(pc);
+    if (iter == s.fastmem_sites.end()) {
+        return false;
+    }
+    s.fastmem_faults++;
+    if (!isRamAddr(guest_addr) && (guest_addr & 0x7fff'fc00) != 0x1f80'0000) {
+        X64Emitter::PatchJmp(reinterpret_cast<u8*>(pc), reinterpret_cast<const u8*>(iter->second));
+        s.fastmem_patches++;
+    }
+    pc = iter->second;
+    return true;
+}
+}// end namespace
+
+namespace Psx {
+namespace Cpu {
+namespace Jit {
+
+void Init(Registers *regs, LoadDelaySlot *lds, BranchDelaySlot *bds)
+{
+    JIT_INFO("Initializing Recompiler");
+    s.regs = regs;
+    s.lds_off = static_cast<i32>(reinterpret_cast<u8*>(lds) - reinterpret_cast<u8*>(regs));
+    s.bds_off = static_cast<i32>(reinterpret_cast<u8*>(bds) - reinterpret_cast<u8*>(regs));
+#ifdef PSX_JIT_X64
+    if (s.code == nullptr) {
+#ifdef _WIN32
+        void *mem = VirtualAlloc(nullptr, CodeBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+        void *mem = mmap(nullptr, CodeBufferSize, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            mem = nullptr;
+        }
+#endif
+        if (mem == nullptr) {
+            JIT_ERROR("Failed to allocate executable memory, recompiler disabled");
+        }
+        s.code = static_cast<u8*>(mem);
+    }
+#endif
+    Fastmem::SetFaultHandler(&handleFastmemFault);
+    Reset();
+}
+
+void Reset()
+{
+    JIT_INFO("Resetting state");
+    Flush();
+    s.num_compiled = 0;
+    s.opt_stats = OptStats();
+    s.fastmem_faults = 0;
+    s.fastmem_patches = 0;
+    s.pending = nullptr;
+}
+
+bool IsSupported()
+{
+    return s.code != nullptr;
+}
+
+/*
+ * Compile the block to host code. Returns nullptr if the block could not be
+ * compiled, in which case it should just be interpreted.
+ */
+BlockFn Compile(const BlockCache::Block& block)
+{
+    if (!IsSupported()) {
+        return nullptr;
+    }
+    if (CodeBufferSize - s.code_used < MaxBlockCodeSize) {
+        JIT_INFO("Code buffer full, flushing");
+        Flush();
+    }
+
+    u8 *start = s.code + s.code_used;
+    X64Emitter emit(start, MaxBlockCodeSize);
+    IrBlock ir;
+    if (s.optimize) {
+        ir = BuildIr(block);
+        s.opt_stats.instrs += block.instrs.size();
+        for (const IrInstr& instr : ir.instrs) {
+            s.opt_stats.no_overflow += instr.no_overflow;
+        }
+    }
+    BlockCompiler compiler(emit, block, ir);
+    compiler.Compile();
+    if (emit.Overflowed()) {
+        JIT_ERROR("Block @ 0x{:08x} too large to compile", block.pc);
+        return nullptr;
+    }
+
+    // keep blocks 16-byte aligned
+    s.code_used += (emit.Pos() + 15) & ~static_cast<size_t>(15);
+    s.num_compiled++;
+    return reinterpret_cast<BlockFn>(start);
+}
+
+/*
+ * Run a compiled block. Returns the number of instructions executed.
+ */
+u32 Run(BlockFn fn)
+{
+    u32 count = fn();
+    if (s.pending) {
+        std::exception_ptr ex = s.pending;
+        s.pending = nullptr;
+        std::rethrow_exception(ex);
+    }
+    return count;
+}
+
+/*
+ * Throw away all compiled code. Blocks compiled in an older epoch will get
+ * recompiled the next time they run.
+ */
+void Flush()
+{
+    s.code_used = 0;
+    s.fastmem_sites.clear();
+    s.epoch++;
+}
+
+u32 Epoch()
+{
+    return s.epoch;
+}
+
+u64 NumCompiled()
+{
+    return s.num_compiled;
+}
+
+size_t CodeBytesUsed()
+{
+    return s.code_used;
+}
+
+size_t CodeBytesTotal()
+{
+    return IsSupported() ? CodeBufferSize : 0;
+}
+
+/*
+ * Turn the optimizing passes on or off. Already compiled code was built with
+ * the old setting, so it gets thrown away.
+ */
+void SetOptimize(bool enable)
+{
+    if (enable != s.optimize) {
+        s.optimize = enable;
+        Flush();
+    }
+}
+
+bool GetOptimize()
+{
+    return s.optimize;
+}
+
+OptStats GetOptStats()
+{
+    return s.opt_stats;
+}
+
+/*
+ * Turn fastmem loads/stores on or off. Only has an effect when the host
+ * supports fastmem (see Fastmem::IsEnabled).
+ */
+void SetFastmem(bool enable)
+{
+    if (enable != s.fastmem) {
+        s.fastmem = enable;
+        Flush();
+    }
+}
+
+bool GetFastmem()
+{
+    return s.fastmem && Fastmem::IsEnabled();
+}
+
+u64 NumFastmemFaults()
+{
+    return s.fastmem_faults;
+}
+
+u64 NumFastmemPatches()
+{
+    return s.fastmem_patches;
+}
+
+}// end namespace
+}
+}
@@ -0,0 +1,60 @@
+/*
+ * jit.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Dynamic recompiler, turns pre-decoded guest blocks into x86-64 host code.
+ */
+
+#pragma once
+
+#include "util/psxutil.hh"
+#include "cpu/_cpu_state.hh"
+#include "cpu/blockcache.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace Jit {
+
+// Runs a compiled block, returns the number of guest instructions executed.
+using BlockFn = u32 (*)();
+
+void Init(Registers *regs, LoadDelaySlot *lds, BranchDelaySlot *bds);
+void Reset();
+
+bool IsSupported();
+BlockFn Compile(const BlockCache::Block& block);
+u32 Run(BlockFn fn);
+void Flush();
+
+// changes every time the code buffer gets flushed
+u32 Epoch();
+
+// optimizing passes (see ir.hh)
+void SetOptimize(bool enable);
+bool GetOptimize();
+
+// loads/stores through the host mapped guest address space
+void SetFastmem(bool enable);
+bool GetFastmem();
+
+// stats
+struct OptStats {
+    u64 instrs = 0;
+    u64 const_folds = 0;
+    u64 dead_writes = 0;
+    u64 no_overflow = 0;
+    u64 direct_mem = 0;
+};
+
+u64 NumCompiled();
+size_t CodeBytesUsed();
+size_t CodeBytesTotal();
+OptStats GetOptStats();
+u64 NumFastmemFaults();
+u64 NumFastmemPatches();
+
+}// end namespace
+}
+}
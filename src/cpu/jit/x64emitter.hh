@@ -0,0 +1,247 @@
+/*
+ * x64emitter.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Tiny x86-64 instruction encoder used by the recompiler. Only the handful
+ * of instructions the recompiler needs are supported. All 32-bit ops work on
+ * the low dword of the given registers.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <initializer_list>
+
+#include "util/psxutil.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace Jit {
+
+enum class Reg : u8 {
+    Rax = 0, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi,
+    R8, R9, R10, R11, R12, R13, R14, R15,
+};
+
+enum class Cond : u8 {
+    O  = 0x0, NO = 0x1, B  = 0x2, AE = 0x3,
+    E  = 0x4, NE = 0x5, BE = 0x6, A  = 0x7,
+    S  = 0x8, NS = 0x9, L  = 0xc, GE = 0xd,
+    LE = 0xe, G  = 0xf,
+};
+
+enum class AluOp : u8 {
+    Add = 0, Or = 1, And = 4, Sub = 5, Xor = 6, Cmp = 7,
+};
+
+enum class ShiftOp : u8 {
+    Shl = 4, Shr = 5, Sar = 7,
+};
+
+// memory operand: [base + index*scale + disp]
+struct Mem {
+    Reg base;
+    i32 disp = 0;
+    bool has_index = false;
+    Reg index = Reg::Rax;
+    u8 scale = 1;
+};
+
+inline Mem Ptr(Reg base, i32 disp = 0)
+{
+    return Mem{base, disp};
+}
+
+inline Mem Ptr(Reg base, Reg index, u8 scale, i32 disp)
+{
+    return Mem{base, disp, true, index, scale};
+}
+
+class X64Emitter {
+public:
+    X64Emitter(u8 *buf, size_t capacity)
+        : m_buf(buf), m_capacity(capacity) {}
+
+    size_t Pos() const { return m_pos; }
+    u8* Start() const { return m_buf; }
+    bool Overflowed() const { return m_overflowed; }
+
+    // *** Moves ***
+    void MovRR(Reg dst, Reg src) { emitRM({0x89}, src, dst, false); }
+    void MovRM(Reg dst, const Mem& m) { emitRM({0x8b}, dst, m, false); }
+    void MovRM64(Reg dst, const Mem& m) { emitRM({0x8b}, dst, m, true); }
+    void MovMR(const Mem& m, Reg src) { emitRM({0x89}, src, m, false); }
+    void MovMR8(const Mem& m, Reg src) { emitRM({0x88}, src, m, false); }
+    void MovMR16(const Mem& m, Reg src) { emit8(0x66); emitRM({0x89}, src, m, false); }
+    void MovMI(const Mem& m, u32 imm) { emitRM({0xc7}, 0, m, false); emit32(imm); }
+    void MovMI8(const Mem& m, u8 imm) { emitRM({0xc6}, 0, m, false); emit8(imm); }
+    void MovRM8(Reg dst, const Mem& m) { emitRM({0x8a}, dst, m, false); }
+    void MovRI(Reg dst, u32 imm)
+    {
+        emitRex(false, 0, 0, idx(dst));
+        emit8(static_cast<u8>(0xb8 + (idx(dst) & 7)));
+        emit32(imm);
+    }
+    void MovRI64(Reg dst, u64 imm)
+    {
+        emitRex(true, 0, 0, idx(dst));
+        emit8(static_cast<u8>(0xb8 + (idx(dst) & 7)));
+        emit32(static_cast<u32>(imm));
+        emit32(static_cast<u32>(imm >> 32));
+    }
+    template<class T>
+    void MovRPtr(Reg dst, T *ptr) { MovRI64(dst, reinterpret_cast<u64>(ptr)); }
+
+    void MovzxRM8(Reg dst, const Mem& m) { emitRM({0x0f, 0xb6}, dst, m, false); }
+    void MovzxRM16(Reg dst, const Mem& m) { emitRM({0x0f, 0xb7}, dst, m, false); }
+    void MovzxRR8(Reg dst, Reg src) { emitRM({0x0f, 0xb6}, dst, src, false); }
+    void MovzxRR16(Reg dst, Reg src) { emitRM({0x0f, 0xb7}, dst, src, false); }
+    void MovsxRR8(Reg dst, Reg src) { emitRM({0x0f, 0xbe}, dst, src, false); }
+    void MovsxRR16(Reg dst, Reg src) { emitRM({0x0f, 0xbf}, dst, src, false); }
+    void MovsxdRM(Reg dst, const Mem& m) { emitRM({0x63}, dst, m, true); }
+
+    // *** Arithmetic ***
+    void AluRR(AluOp op, Reg dst, Reg src) { emitRM({static_cast<u8>(aluBase(op) + 1)}, src, dst, false); }
+    void AluRM(AluOp op, Reg dst, const Mem& m) { emitRM({static_cast<u8>(aluBase(op) + 3)}, dst, m, false); }
+    void AluRI(AluOp op, Reg dst, u32 imm) { emitRM({0x81}, static_cast<u8>(op), dst, false); emit32(imm); }
+    void AluMI(AluOp op, const Mem& m, u32 imm) { emitRM({0x81}, static_cast<u8>(op), m, false); emit32(imm); }
+    void AluRM8(AluOp op, Reg dst, const Mem& m) { emitRM({static_cast<u8>(aluBase(op) + 2)}, dst, m, false); }
+    void CmpMR64(const Mem& m, Reg src) { emitRM({0x39}, src, m, true); }
+    void TestRR(Reg a, Reg b) { emitRM({0x85}, b, a, false); }
+    void TestRI(Reg dst, u32 imm) { emitRM({0xf7}, 0, dst, false); emit32(imm); }
+    void Not(Reg dst) { emitRM({0xf7}, 2, dst, false); }
+    void Neg(Reg dst) { emitRM({0xf7}, 3, dst, false); }
+    void ShiftRI(ShiftOp op, Reg dst, u8 amount) { emitRM({0xc1}, static_cast<u8>(op), dst, false); emit8(amount); }
+    void ShiftRCl(ShiftOp op, Reg dst) { emitRM({0xd3}, static_cast<u8>(op), dst, false); }
+    void ShiftRI64(ShiftOp op, Reg dst, u8 amount) { emitRM({0xc1}, static_cast<u8>(op), dst, true); emit8(amount); }
+    void ImulRR64(Reg dst, Reg src) { emitRM({0x0f, 0xaf}, dst, src, true); }
+    void AddRspI(u8 imm) { emitRM({0x83}, 0, Reg::Rsp, true); emit8(imm); }
+    void SubRspI(u8 imm) { emitRM({0x83}, 5, Reg::Rsp, true); emit8(imm); }
+
+    // *** Control Flow ***
+    void Push(Reg r) { emitRex(false, 0, 0, idx(r)); emit8(static_cast<u8>(0x50 + (idx(r) & 7))); }
+    void Pop(Reg r) { emitRex(false, 0, 0, idx(r)); emit8(static_cast<u8>(0x58 + (idx(r) & 7))); }
+    void CallR(Reg r) { emitRM({0xff}, 2, r, false); }
+    void Ret() { emit8(0xc3); }
+    void Nop() { emit8(0x90); }
+
+    // forward jumps return the position of their rel32, to be bound later
+    size_t Jcc(Cond cc)
+    {
+        emit8(0x0f);
+        emit8(static_cast<u8>(0x80 + static_cast<u8>(cc)));
+        emit32(0);
+        return m_pos - 4;
+    }
+    size_t Jmp()
+    {
+        emit8(0xe9);
+        emit32(0);
+        return m_pos - 4;
+    }
+    void JmpTo(size_t target)
+    {
+        emit8(0xe9);
+        emit32(static_cast<u32>(static_cast<i64>(target) - static_cast<i64>(m_pos + 4)));
+    }
+
+    // overwrite already emitted code at the given address with a jump
+    static constexpr size_t JmpSize = 5;
+    static void PatchJmp(u8 *at, const u8 *target)
+    {
+        u32 rel = static_cast<u32>(target - (at + JmpSize));
+        at[0] = 0xe9;
+        std::memcpy(at + 1, &rel, sizeof(rel));
+    }
+
+    // point a forward jump at the current position (or at target)
+    void Bind(size_t rel_pos) { BindTo(rel_pos, m_pos); }
+    void BindTo(size_t rel_pos, size_t target)
+    {
+        if (m_overflowed) {
+            return;
+        }
+        u32 rel = static_cast<u32>(static_cast<i64>(target) - static_cast<i64>(rel_pos + 4));
+        std::memcpy(m_buf + rel_pos, &rel, sizeof(rel));
+    }
+
+private:
+    static u8 idx(Reg r) { return static_cast<u8>(r); }
+    static u8 aluBase(AluOp op) { return static_cast<u8>(static_cast<u8>(op) << 3); }
+
+    void emit8(u8 byte)
+    {
+        if (m_pos >= m_capacity) {
+            m_overflowed = true;
+            return;
+        }
+        m_buf[m_pos++] = byte;
+    }
+
+    void emit32(u32 word)
+    {
+        for (int i = 0; i < 4; i++) {
+            emit8(static_cast<u8>(word >> (8 * i)));
+        }
+    }
+
+    void emitRex(bool w, u8 reg, u8 index, u8 base)
+    {
+        u8 rex = static_cast<u8>(0x40 | (w << 3) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+        if (rex != 0x40) {
+            emit8(rex);
+        }
+    }
+
+    void emitOpcode(std::initializer_list<u8> opcode)
+    {
+        for (u8 byte : opcode) {
+            emit8(byte);
+        }
+    }
+
+    // register direct operand
+    void emitRM(std::initializer_list<u8> opcode, Reg reg, Reg rm, bool w) { emitRM(opcode, idx(reg), rm, w); }
+    void emitRM(std::initializer_list<u8> opcode, u8 reg, Reg rm, bool w)
+    {
+        emitRex(w, reg, 0, idx(rm));
+        emitOpcode(opcode);
+        emit8(static_cast<u8>(0xc0 | ((reg & 7) << 3) | (idx(rm) & 7)));
+    }
+
+    // memory operand
+    void emitRM(std::initializer_list<u8> opcode, Reg reg, const Mem& m, bool w) { emitRM(opcode, idx(reg), m, w); }
+    void emitRM(std::initializer_list<u8> opcode, u8 reg, const Mem& m, bool w)
+    {
+        u8 base = idx(m.base);
+        u8 index = m.has_index ? idx(m.index) : 0;
+        emitRex(w, reg, index, base);
+        emitOpcode(opcode);
+
+        bool disp8 = m.disp >= -128 && m.disp <= 127;
+        u8 mod = disp8 ? 0x40 : 0x80;
+        bool need_sib = m.has_index || (base & 7) == 4;
+        emit8(static_cast<u8>(mod | ((reg & 7) << 3) | (need_sib ? 4 : (base & 7))));
+        if (need_sib) {
+            u8 scale_bits = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+            u8 sib_index = m.has_index ? (index & 7) : 4; // 4 == no index
+            emit8(static_cast<u8>((scale_bits << 6) | (sib_index << 3) | (base & 7)));
+        }
+        if (disp8) {
+            emit8(static_cast<u8>(m.disp));
+        } else {
+            emit32(static_cast<u32>(m.disp));
+        }
+    }
+
+    u8 *m_buf;
+    size_t m_capacity;
+    size_t m_pos = 0;
+    bool m_overflowed = false;
+};
+
+}// end namespace
+}
+}
@@ -0,0 +1,318 @@
+/*
+ * transcache.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * On-disk cache of hot blocks. Host code can't be saved as is since it has
+ * the addresses of the register file, helpers and block data baked in, so
+ * the cache keeps the hotness profile instead: the start pc, length and a
+ * hash of the guest code of every block that got recompiled in the tiered
+ * mode. Blocks whose code still hashes the same are promoted straight to the
+ * recompiler the first time they run. The file is mapped read-only, and
+ * entries are checked lazily as their pc comes up, so loading is cheap no
+ * matter how big the profile gets.
+ *
+ * File layout: a Header followed by Header::count Entry structs, in host
+ * byte order. The build key makes files from other builds get ignored.
+ */
+
+#include "cpu/transcache.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+#include "mem/bus.hh"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define TC_INFO(...) PSXLOG_INFO("Trans-Cache", __VA_ARGS__)
+#define TC_WARN(...) PSXLOG_WARN("Trans-Cache", __VA_ARGS__)
+#define TC_ERROR(...) PSXLOG_ERROR("Trans-Cache", __VA_ARGS__)
+
+// bump whenever the file layout or block building rules change
+constexpr u32 TransCacheVersion = 1;
+constexpr char TransCacheMagic[8] = {'P', 'S', 'X', 'T', 'C', 'A', 'C', 'H'};
+
+// *** Private Data and Helpers ***
+namespace  {
+struct Header {
+    char magic[8];
+    u32 version;
+    u32 count;
+    u64 build_key;
+};
+
+struct Entry {
+    u64 hash;
+    u32 pc;
+    u32 len;
+};
+
+struct State {
+    // mapped file, entries point into this
+    const u8 *map = nullptr;
+    size_t map_size = 0;
+#ifdef _WIN32
+    std::vector<u8> file_data;
+#endif
+    // loaded entries that haven't been checked against guest code yet
+    std::unordered_map<u32, const Entry*> loaded;
+    size_t num_loaded = 0;
+    // blocks that got hot this run
+    std::unordered_map<u32, Entry> recorded;
+    u64 hits = 0;
+} s;
+
+u64 fnv1a(const void *data, size_t size, u64 hash = 0xcbf2'9ce4'8422'2325)
+{
+    const u8 *bytes = static_cast<const u8*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x0000'0100'0000'01b3;
+    }
+    return hash;
+}
+
+/*
+ * Identifies the emulator build. Anything built with a different version
+ * or file layout can't use the same file.
+ */
+u64 buildKey()
+{
+    const char id[] = PROJECT_NAME " " PROJECT_VER;
+    u64 hash = fnv1a(id, sizeof(id));
+    u32 layout[] = {TransCacheVersion, static_cast<u32>(sizeof(Header)), static_cast<u32>(sizeof(Entry)),
+        Psx::Cpu::BlockCache::MaxBlockLen};
+    return fnv1a(layout, sizeof(layout), hash);
+}
+
+/*
+ * Hash of the guest code words of a block.
+ */
+u64 hashCode(u32 pc, u32 len)
+{
+    u64 hash = fnv1a(&len, sizeof(len));
+    for (u32 i = 0; i < len; i++) {
+        u32 word = Psx::Bus::Read<u32>(pc + 4 * i);
+        hash = fnv1a(&word, sizeof(word), hash);
+    }
+    return hash;
+}
+
+void unmap()
+{
+#ifdef _WIN32
+    s.file_data.clear();
+#else
+    if (s.map != nullptr) {
+        munmap(const_cast<u8*>(s.map), s.map_size);
+    }
+#endif
+    s.map = nullptr;
+    s.map_size = 0;
+    s.loaded.clear();
+    s.num_loaded = 0;
+}
+
+/*
+ * Map the whole file read-only. Returns false if it can't be opened.
+ */
+bool mapFile(const std::string& path)
+{
+#ifdef _WIN32
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    s.file_data.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(s.file_data.data()), static_cast<std::streamsize>(s.file_data.size()));
+    s.map = s.file_data.data();
+    s.map_size = s.file_data.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after the fd is gone
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    s.map = static_cast<const u8*>(mem);
+    s.map_size = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+}// end namespace
+
+namespace Psx {
+namespace Cpu {
+namespace TransCache {
+
+/*
+ * Load a cache file, replacing anything loaded before. Returns false if the
+ * file doesn't exist or was written by another build.
+ */
+bool Load(const std::string& path)
+{
+    unmap();
+    if (!mapFile(path)) {
+        TC_INFO("No translation cache at {}", path);
+        return false;
+    }
+
+    Header header;
+    if (s.map_size < sizeof(Header)) {
+        TC_WARN("Translation cache {} is truncated, ignoring it", path);
+        unmap();
+        return false;
+    }
+    std::memcpy(&header, s.map, sizeof(Header));
+    if (std::memcmp(header.magic, TransCacheMagic, sizeof(TransCacheMagic)) != 0
+     || header.version != TransCacheVersion || header.build_key != buildKey()) {
+        TC_WARN("Translation cache {} is from another build, ignoring it", path);
+        unmap();
+        return false;
+    }
+    if (s.map_size < sizeof(Header) + header.count * sizeof(Entry)) {
+        TC_WARN("Translation cache {} is truncated, ignoring it", path);
+        unmap();
+        return false;
+    }
+
+    const Entry *entries = reinterpret_cast<const Entry*>(s.map + sizeof(Header));
+    s.loaded.reserve(header.count);
+    for (u32 i = 0; i < header.count; i++) {
+        s.loaded[entries[i].pc] = &entries[i];
+    }
+    s.num_loaded = s.loaded.size();
+    TC_INFO("Loaded {} hot blocks from {}", s.num_loaded, path);
+    return true;
+}
+
+/*
+ * Write everything loaded (and not proven stale) plus everything recorded
+ * this run. The file is written next to the target and renamed over it, so
+ * runs sharing the same file never see a partial one.
+ */
+bool Save(const std::string& path)
+{
+    std::vector<Entry> entries;
+    entries.reserve(s.loaded.size() + s.recorded.size());
+    for (const auto& [pc, entry] : s.loaded) {
+        if (s.recorded.count(pc) == 0) {
+            entries.push_back(*entry);
+        }
+    }
+    for (const auto& [pc, entry] : s.recorded) {
+        entries.push_back(entry);
+    }
+
+    Header header;
+    std::memcpy(header.magic, TransCacheMagic, sizeof(TransCacheMagic));
+    header.version = TransCacheVersion;
+    header.count = static_cast<u32>(entries.size());
+    header.build_key = buildKey();
+
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()),
+            static_cast<std::streamsize>(entries.size() * sizeof(Entry)));
+        if (!file) {
+            TC_ERROR("Failed to write translation cache to {}", tmp_path);
+            std::remove(tmp_path.c_str());
+            return false;
+        }
+    }
+#ifdef _WIN32
+    // rename won't replace an existing file here
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        TC_ERROR("Failed to move translation cache to {}", path);
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    TC_INFO("Saved {} hot blocks to {}", entries.size(), path);
+    return true;
+}
+
+/*
+ * Forget everything loaded and recorded.
+ */
+void Clear()
+{
+    unmap();
+    s.recorded.clear();
+    s.hits = 0;
+}
+
+/*
+ * Remember a block that got hot, to be saved with the next Save().
+ */
+void Record(const BlockCache::Block& block)
+{
+    u32 len = static_cast<u32>(block.instrs.size());
+    s.recorded[block.pc] = {hashCode(block.pc, len), block.pc, len};
+}
+
+/*
+ * Returns true if a loaded entry says the block at pc got hot before and the
+ * guest code there hasn't changed since. Each entry is only checked once.
+ */
+bool IsHot(u32 pc)
+{
+    if (s.loaded.empty()) {
+        return false;
+    }
+    auto iter = s.loaded.find(pc);
+    if (iter == s.loaded.end()) {
+        return false;
+    }
+    const Entry *entry = iter->second;
+    s.loaded.erase(iter);
+    if (entry->len == 0 || entry->len > BlockCache::MaxBlockLen || hashCode(pc, entry->len) != entry->hash) {
+        return false;
+    }
+    // keep it for the next save
+    s.recorded[pc] = *entry;
+    s.hits++;
+    return true;
+}
+
+size_t NumLoaded()
+{
+    return s.num_loaded;
+}
+
+size_t NumRecorded()
+{
+    return s.recorded.size();
+}
+
+u64 NumHits()
+{
+    return s.hits;
+}
+
+}// end namespace
+}
+}
@@ -0,0 +1,36 @@
+/*
+ * transcache.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * On-disk cache of the blocks that got hot in earlier runs, so the tiered
+ * mode can recompile them right away instead of warming up again.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "util/psxutil.hh"
+#include "cpu/blockcache.hh"
+
+namespace Psx {
+namespace Cpu {
+namespace TransCache {
+
+bool Load(const std::string& path);
+bool Save(const std::string& path);
+void Clear();
+
+void Record(const BlockCache::Block& block);
+bool IsHot(u32 pc);
+
+// stats
+size_t NumLoaded();
+size_t NumRecorded();
+u64 NumHits();
+
+}// end namespace
+}
+}
@@ -5,14 +5,28 @@
  * 2/13/2021
  *
  * GPU for the PSX.
+ *
+ * Also generates the video timing. The GPU clock runs at 11/7 of the cpu
+ * clock, a scanline is 3413 (NTSC) or 3406 (PAL) GPU cycles and a frame is
+ * 263 or 314 scanlines (one less every other field when interlaced). Three
+ * scheduled events per scanline mark the end and start of hblank and the
+ * end of the line, which drive the timers' sync modes and hblank clock, the
+ * VBLANK interrupt and GPUSTAT.31. Hblank and vblank are the parts of the
+ * line and frame outside of the GP1(06h/07h) display ranges.
  */
 
 #include "gpu.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <queue>
 
 #include "imgui/imgui.h"
 
+#include "core/scheduler.hh"
+#include "cpu/interrupt.hh"
+#include "io/timer.hh"
+#include "mem/arena.hh"
 #include "mem/ram.hh"
 #include "view/imgui/dbgmod.hh"
 #include "view/geometry.hh"
@@ -25,6 +39,12 @@
 
 #define GPU_CMD_NONE 0xff
 
+// video timing, in GPU cycles
+#define NTSC_CYCLES_PER_LINE (3413)
+#define PAL_CYCLES_PER_LINE (3406)
+#define NTSC_LINES_PER_FRAME (263)
+#define PAL_LINES_PER_FRAME (314)
+
 namespace Psx {
 namespace Gpu {
 // *** Private Data ***
@@ -57,6 +77,13 @@ struct PolyConfig {
     // TODO
 };
 
+// where the video timing is in the current scanline
+enum class VideoPhase {
+    HblankEnd,
+    HblankStart,
+    LineEnd,
+};
+
 struct State {
     // status register
     u32 sr = 0;
@@ -96,10 +123,24 @@ struct State {
         u16 range_y2 = 0;
     } display;
 
-    // 1MB of vram
-    std::vector<u8> vram;
+    // 1MB of vram, lives in the arena
+    u8 *vram = nullptr;
+
+    struct Video {
+        // GPU cycle the current scanline started at
+        u64 line_start = 0;
+        u32 line = 0;
+        // next event
+        VideoPhase phase = VideoPhase::HblankEnd;
+        bool odd_field = false;
+        bool in_vblank = false;
+        u64 frames = 0;
+    } video;
 }s;
 
+// outside of the state so it survives resets
+Scheduler::EventHandle video_event;
+
 
 // Prototypes
 void handleGP1Cmd(u32 word);
@@ -117,6 +158,11 @@ void displayMode(u32 word);
 void displayEnvInfo();
 void displayStatusRegister();
 void finishedCommand();
+void videoEvent(u32 cycles_late);
+void startVideo();
+u32 cyclesPerLine();
+u32 linesPerFrame();
+u64 cpuCycleAt(u64 gpu_cycle);
 // poly commands
 void handleMonoPoly(u32 word, const PolyConfig& config);
 void handleShadedPoly(u32 word, const PolyConfig& config);
@@ -129,8 +175,10 @@ void handleShadedTexturedPoly(u32 word, const PolyConfig& config);
 void Init()
 {
     GPU_INFO("Initializing state");
-    s.vram.resize(1 * 1024 * 1024);
+    s.vram = Arena::VramBase();
     Util::SetBits(s.sr, 26, 3, 0x7);
+    video_event = Scheduler::Register("Video Timing", videoEvent);
+    startVideo();
 }
 
 void Reset()
@@ -140,8 +188,10 @@ void Reset()
     s.gp0_state = Gp0State::Ready;
     s = {};
     Util::SetBits(s.sr, 26, 3, 0x7);
-    // vram was reset, so need to resize
-    s.vram.resize(1 * 1024 * 1024);
+    // vram pointer was reset too
+    s.vram = Arena::VramBase();
+    std::memset(s.vram, 0, Arena::VramSize);
+    startVideo();
 }
 
 void RenderFrame()
@@ -150,39 +200,35 @@ void RenderFrame()
 }
 
 /*
- * Performs one step in the gpu operation. Usually this entails processing the
- * next command in the queue. Returns true if new frame ready to render.
+ * Number of frames (fields when interlaced) the video timing has started.
  */
-bool Step()
-{
-    // if (s.cmd_queue.size() != 0) {
-    //     // we still have commands to handle
-    //     u32 word = s.cmd_queue.front();
-    //     s.cmd_queue.pop();
-    //     handleGP0Cmd(word);
-    // }
-    // if (s.cmd == CmdType::None) {
-    //     // we are ready to receive command words
-    //     // and we are ready for dma
-    //     // and we are not busy
-    //     Util::SetBits(s.sr, 26, 3, 0x7);
-    // }
-
-    // do something i guess :/
-    // s.renderer->RenderSomething();
-
-    static u32 count = 0;
-    bool new_frame = false;
-    // if (count > 2413 * 263) {
-    if (count > 2413) {
-        new_frame = true;
-        count = 0;
-    } else {
-        count++;
-        new_frame = false;
+u64 FrameCount()
+{
+    return s.video.frames;
+}
+
+/*
+ * Cpu cycles from now until the next frame (field when interlaced) starts,
+ * going by the current video mode.
+ */
+u32 CyclesToNextFrame()
+{
+    u32 lines = std::max(linesPerFrame(), s.video.line + 1);
+    u64 frame_end = s.video.line_start + static_cast<u64>(lines - s.video.line) * cyclesPerLine();
+    u64 now = Scheduler::Now();
+    if (cpuCycleAt(frame_end) <= now) {
+        // the new frame starts on the pending event, run all of it
+        frame_end += static_cast<u64>(linesPerFrame()) * cyclesPerLine();
     }
+    return static_cast<u32>(cpuCycleAt(frame_end) - now);
+}
 
-    return false;
+/*
+ * Returns true if the display mode is PAL (GPUSTAT bit 20).
+ */
+bool IsPal()
+{
+    return Util::GetBits(s.sr, 20, 1);
 }
 
 // *** Read ***
@@ -725,8 +771,8 @@ void softReset()
     horzDisplayRange(word);
     // display y1,y2 (y1=010h, y2=010h+240)
     word = 0;
-    Util::SetBits(word, 0, 12, 0x010);
-    Util::SetBits(word, 12, 12, 0x010 + 240);
+    Util::SetBits(word, 0, 10, 0x010);
+    Util::SetBits(word, 10, 10, 0x010 + 240);
     vertDisplayRange(word);
     // display mode 320x200 NTSC (0)
     displayMode(0x0000'0001);
@@ -777,6 +823,18 @@ void vertDisplayRange(u32 word)
     s.display.range_y2 = static_cast<u16>(Util::GetBits(word, 10, 10));
 }
 
+/*
+ * Dot clock divider for the horizontal resolution in GPUSTAT.
+ */
+u32 dotClockDivider()
+{
+    if (Util::GetBits(s.sr, 16, 1)) {
+        return 7; // 368
+    }
+    constexpr u32 Dividers[] = {10, 8, 5, 4}; // 256, 320, 512, 640
+    return Dividers[Util::GetBits(s.sr, 17, 2)];
+}
+
 void displayMode(u32 word)
 {
     Util::SetBits(s.sr, 17, 2, word);
@@ -791,6 +849,121 @@ void displayMode(u32 word)
     Util::SetBits(s.sr, 22, 1, word >> 5);
     Util::SetBits(s.sr, 16, 1, word >> 6);
     Util::SetBits(s.sr, 14, 1, word >> 7);
+    Timer::SetDotClock(dotClockDivider());
+}
+
+//+++++++++++++++++++++++++++++
+// Video Timing
+//+++++++++++++++++++++++++++++
+bool isInterlaced()
+{
+    return Util::GetBits(s.sr, 22, 1);
+}
+
+u32 cyclesPerLine()
+{
+    return IsPal() ? PAL_CYCLES_PER_LINE : NTSC_CYCLES_PER_LINE;
+}
+
+u32 linesPerFrame()
+{
+    u32 lines = IsPal() ? PAL_LINES_PER_FRAME : NTSC_LINES_PER_FRAME;
+    if (isInterlaced()) {
+        // 262.5 or 313.5 lines a field
+        return (IsPal() ? lines - 1 : lines) - (s.video.odd_field ? 1 : 0);
+    }
+    return lines;
+}
+
+/*
+ * GPU cycle within the line the next video event is due at.
+ */
+u32 phaseOffset(VideoPhase phase)
+{
+    u32 line_cycles = cyclesPerLine();
+    u32 x1 = std::min<u32>(s.display.range_x1, line_cycles);
+    u32 x2 = std::clamp<u32>(s.display.range_x2, x1, line_cycles);
+    switch (phase) {
+    case VideoPhase::HblankEnd: return x1;
+    case VideoPhase::HblankStart: return x2;
+    case VideoPhase::LineEnd: return line_cycles;
+    }
+    return line_cycles;
+}
+
+/*
+ * First cpu cycle at or after the gpu cycle.
+ */
+u64 cpuCycleAt(u64 gpu_cycle)
+{
+    return (gpu_cycle * 7 + 10) / 11;
+}
+
+void scheduleVideo()
+{
+    u64 gpu_cycle = s.video.line_start + phaseOffset(s.video.phase);
+    Scheduler::ScheduleAt(video_event, cpuCycleAt(gpu_cycle));
+}
+
+/*
+ * Start of a new scanline, handles the frame and vblank boundaries.
+ */
+void startLine()
+{
+    s.video.line++;
+    if (s.video.line >= linesPerFrame()) {
+        s.video.line = 0;
+        s.video.odd_field = isInterlaced() && !s.video.odd_field;
+        s.video.frames++;
+    }
+
+    bool vblank = s.video.line < s.display.range_y1 || s.video.line >= s.display.range_y2;
+    if (vblank != s.video.in_vblank) {
+        s.video.in_vblank = vblank;
+        Timer::SetVblank(vblank);
+        if (vblank) {
+            Interrupt::Signal(Interrupt::Type::Vblank);
+        }
+    }
+
+    // odd/even line, the field when interlaced and always even in vblank
+    bool odd = isInterlaced() ? s.video.odd_field : (s.video.line & 0x1);
+    Util::SetBits(s.sr, 31, 1, !vblank && odd);
+}
+
+void videoEvent(u32 cycles_late)
+{
+    (void) cycles_late;
+    switch (s.video.phase) {
+    case VideoPhase::HblankEnd:
+        Timer::SetHblank(false);
+        s.video.phase = VideoPhase::HblankStart;
+        break;
+    case VideoPhase::HblankStart:
+        Timer::SetHblank(true);
+        s.video.phase = VideoPhase::LineEnd;
+        break;
+    case VideoPhase::LineEnd:
+        s.video.line_start += cyclesPerLine();
+        startLine();
+        s.video.phase = VideoPhase::HblankEnd;
+        break;
+    }
+    scheduleVideo();
+}
+
+/*
+ * Restart the video timing at the first line of a frame, in hblank.
+ */
+void startVideo()
+{
+    s.video = {};
+    s.video.line_start = Scheduler::Now() * 11 / 7;
+    s.video.in_vblank = true;
+    Timer::SetHblank(true);
+    Timer::SetVblank(true);
+    Timer::SetDotClock(dotClockDivider());
+    scheduleVideo();
 }
 
 //+++++++++++++++++++++++++++++
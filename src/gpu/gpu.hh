@@ -17,7 +17,9 @@ namespace Gpu {
 void Init();
 void Reset();
 void RenderFrame();
-bool Step();
+u64 FrameCount();
+u32 CyclesToNextFrame();
+bool IsPal();
 
 template<class T> T Read(u32 addr);
 template<class T> void Write(T data, u32 addr);
@@ -9,6 +9,12 @@
  *   1F80110xh      Timer 0 Dotclock
  *   1F80111xh      Timer 1 Horizontal Retrace
  *   1F80112xh      Timer 2 1/8 system clock
+ *
+ * The counters don't tick. Each one keeps the value it had at some cycle and
+ * the clock it counts, and the current value is worked out from the time
+ * when it's read. The only upkeep is one scheduled event per timer at the
+ * exact cycle it next reaches its target or 0xffff, which sets the flags
+ * and raises the IRQ.
  */
 
 #include "timer.hh"
@@ -17,6 +23,8 @@
 
 #include "util/psxutil.hh"
 #include "util/psxlog.hh"
+#include "core/scheduler.hh"
+#include "cpu/cpu.hh"
 #include "cpu/interrupt.hh"
 #include "view/imgui/dbgmod.hh"
 
@@ -39,8 +47,31 @@ enum TimerNum {
     SysClock = 2
 };
 
+// counts one tick every num/den cpu cycles
+struct Clock {
+    u32 num;
+    u32 den;
+};
+constexpr Clock SystemClock = {1, 1};
+constexpr Clock SystemClockDiv8 = {8, 1};
+
+struct Counter {
+    // value at the start cycle
+    u32 base = 0;
+    u64 start = 0;
+    // progress towards the next tick at the start cycle, in 1/den cycles
+    u32 phase = 0;
+    // stopped by the sync mode
+    bool paused = false;
+    // a one-shot irq has fired since the mode was written
+    bool irq_done = false;
+    // what the scheduled match event is for
+    bool match_target = false;
+    bool match_ffff = false;
+};
+
 struct State {
-    u16 timer_val[NUM_TIMERS] = {0};
+    Counter counters[NUM_TIMERS];
     u16 timer_target[NUM_TIMERS] = {0};
     union TimerModeReg {
         //   0     Synchronization Enable (0=Free Run, 1=Synchronize via Bit1-2)
@@ -86,13 +117,26 @@ struct State {
         } fields;
         u16 raw;
     } timer_mode[NUM_TIMERS];
+
+    bool in_hblank = false;
+    bool in_vblank = false;
+    // one dot in cpu cycles, the gpu runs at 11/7 of the cpu clock (256 wide)
+    Clock dot_clock = {10 * 7, 11};
 } s;
 
+// outside of the state so they survive resets
+Scheduler::EventHandle match_events[NUM_TIMERS];
+
 // protos
 void debugPrintTimerMode(u32 timer_num);
-void sysClockStep();
-void horzRetraceStep();
-void dotClockStep();
+u32 valueAt(u32 timer_num, u64 now);
+void rebase(u32 timer_num, u64 now);
+void updatePaused(u32 timer_num, u64 now);
+void scheduleMatch(u32 timer_num);
+void setBlank(u32 timer_num, bool blank);
+template<u32 timer_num> void onMatch(u32 cycles_late);
+bool countsHblanks(u32 timer_num);
+void hblankTick(u32 timer_num);
 
 } // end private ns
 
@@ -101,50 +145,55 @@ void Init()
     TIMER_INFO("Initializing timers");
     s = {};
     static_assert(sizeof(State::TimerModeReg) == sizeof(u16));
+    match_events[TimerNum::Dotclock] = Scheduler::Register("Timer 0 Match", onMatch<TimerNum::Dotclock>);
+    match_events[TimerNum::HorzRetrace] = Scheduler::Register("Timer 1 Match", onMatch<TimerNum::HorzRetrace>);
+    match_events[TimerNum::SysClock] = Scheduler::Register("Timer 2 Match", onMatch<TimerNum::SysClock>);
+    Reset();
 }
 
 void Reset()
 {
     TIMER_INFO("Resetting timers");
     s = {};
+    for (u32 timer_num = 0; timer_num < NUM_TIMERS; timer_num++) {
+        s.counters[timer_num].start = Scheduler::Now();
+        scheduleMatch(timer_num);
+    }
 }
 
-void Step()
+/*
+ * Start or end of hblank, timer 0 can sync to it and timer 1 can count them.
+ */
+void SetHblank(bool active)
 {
-    // Dotclock step
-    dotClockStep();
-
-    // Horizontal Retrace step
-    horzRetraceStep();
+    setBlank(TimerNum::Dotclock, active);
+    if (active && countsHblanks(TimerNum::HorzRetrace) && !s.counters[TimerNum::HorzRetrace].paused) {
+        hblankTick(TimerNum::HorzRetrace);
+    }
+}
 
-    // System Clock step
-    sysClockStep();
+/*
+ * Start or end of vblank, timer 1 can sync to it.
+ */
+void SetVblank(bool active)
+{
+    setBlank(TimerNum::HorzRetrace, active);
+}
 
-    for (u32 timer_num = 0; timer_num < NUM_TIMERS; timer_num++) {
-        u16 reset_target = s.timer_mode[timer_num].fields.reset_mode == 0 
-                           ? 0xffff : s.timer_target[timer_num];
-        if (s.timer_val[timer_num] == reset_target) {
-            s.timer_val[timer_num] = 0;
-            // TODO irqs
-            if (s.timer_mode[timer_num].fields.irq_disabled == 0) {
-                Interrupt::Type itype;
-                switch (timer_num) {
-                case TimerNum::Dotclock: itype = Interrupt::Type::Timer0; break;
-                case TimerNum::HorzRetrace: itype = Interrupt::Type::Timer1; break;
-                case TimerNum::SysClock: itype = Interrupt::Type::Timer2; break;
-                default: PSX_ASSERT(0);
-                }
-                Interrupt::Signal(itype);
-            }
-            
-            // reached target/ffff
-            if (reset_target == 0xffff) {
-                s.timer_mode[timer_num].fields.reached_ffff = 1;
-            } else {
-                s.timer_mode[timer_num].fields.reached_target = 1;
-            }
-        }
+/*
+ * The gpu's dot clock divider changed with its horizontal resolution.
+ */
+void SetDotClock(u32 divider)
+{
+    Clock clock = {divider * 7, 11};
+    if (clock.num == s.dot_clock.num) {
+        return;
     }
+    rebase(TimerNum::Dotclock, Scheduler::Now());
+    s.dot_clock = clock;
+    // partway to the next dot of the old clock, close enough
+    s.counters[TimerNum::Dotclock].phase = 0;
+    scheduleMatch(TimerNum::Dotclock);
 }
 
 // *** Read ***
@@ -158,7 +207,9 @@ T Read(u32 addr)
 
     switch (offset) {
     case 0x00: // value
-        data = (T)s.timer_val[timer_num];
+        data = static_cast<T>(valueAt(timer_num, Scheduler::Now()));
+        // counts without events, polling it isn't idle
+        Cpu::BreakIdleLoop();
         break;
     case 0x04: // mode
         data = (T)s.timer_mode[timer_num].raw;
@@ -187,22 +238,30 @@ void Write(T data, u32 addr)
     u32 timer_num = (addr >> 4) & 0x3;
     PSX_ASSERT(timer_num < NUM_TIMERS);
     u32 offset = addr & 0xf;
+    u64 now = Scheduler::Now();
+    Counter& counter = s.counters[timer_num];
 
     switch (offset) {
     case 0x00: // value
-        s.timer_val[timer_num] = (u16) data;
+        rebase(timer_num, now);
+        counter.base = data & 0xffffu;
         break;
     case 0x04: // mode
-        s.timer_mode[timer_num].raw = (u16) data;
+        // the reached flags stay, bit 10 is set
+        s.timer_mode[timer_num].raw = static_cast<u16>((data & 0xe3ffu) | (s.timer_mode[timer_num].raw & 0x1800u) | 0x0400u);
         // reset timer val
-        s.timer_val[timer_num] = 0;
+        counter = {};
+        counter.start = now;
+        updatePaused(timer_num, now);
         break;
     case 0x08: // target
-        s.timer_target[timer_num] = (u16) data;
+        rebase(timer_num, now);
+        s.timer_target[timer_num] = static_cast<u16>(data & 0xffffu);
         break;
     default:
         TIMER_FATAL("Unknown timer register address [{:08x}], offset: {:02x}", addr, offset);
     }
+    scheduleMatch(timer_num);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template void Write<u8>(u8 data, u32 addr);
@@ -216,15 +275,16 @@ void OnActive(bool *active)
         return;
     }
 
+    u64 now = Scheduler::Now();
     ImGui::TextUnformatted("Registers");
     ImGui::Separator();
     ImGui::BeginGroup();
         ImGui::BeginGroup();
             // Value
             ImGui::Text("Timer Value");
-            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "DotClock", s.timer_val[TimerNum::Dotclock], s.timer_val[TimerNum::Dotclock]).c_str());
-            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "HorzRetrace", s.timer_val[TimerNum::HorzRetrace], s.timer_val[TimerNum::HorzRetrace]).c_str());
-            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "SysClock", s.timer_val[TimerNum::SysClock], s.timer_val[TimerNum::SysClock]).c_str());
+            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "DotClock", valueAt(TimerNum::Dotclock, now), valueAt(TimerNum::Dotclock, now)).c_str());
+            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "HorzRetrace", valueAt(TimerNum::HorzRetrace, now), valueAt(TimerNum::HorzRetrace, now)).c_str());
+            ImGui::TextUnformatted(PSX_FMT("{:<12} = 0x{:04x} ({:05})", "SysClock", valueAt(TimerNum::SysClock, now), valueAt(TimerNum::SysClock, now)).c_str());
         ImGui::EndGroup();
         ImGui::SameLine();
         ImGui::BeginGroup();
@@ -287,61 +347,240 @@ void debugPrintTimerMode(u32 timer_num)
     ImGui::TextUnformatted(PSX_FMT("Reached 0xffff : {}", m->fields.reached_ffff).c_str());
 }
 
-void sysClockStep()
+Clock clockOf(u32 timer_num)
 {
-    const State::TimerModeReg *sysclk_mode = &s.timer_mode[TimerNum::SysClock];
-    static u32 s_cpu_clock = 0;
-    // step every clock or once every 8 clocks...
-    const u32 clocks_before_count = sysclk_mode->fields.clock_src == 0 
-                                 || sysclk_mode->fields.clock_src == 1 
-                                  ? 0 : 8;
-    if (s_cpu_clock++ < clocks_before_count) {
-        return;
-    } 
-    s_cpu_clock = 0;
-    if (sysclk_mode->fields.sync_enable && 
-       (sysclk_mode->fields.sync_mode == 0 || 
-        sysclk_mode->fields.sync_mode == 3)) {
-        // no counting
+    u16 clock_src = s.timer_mode[timer_num].fields.clock_src;
+    if (timer_num == TimerNum::Dotclock) {
+        return clock_src & 0x1 ? s.dot_clock : SystemClock;
+    }
+    if (timer_num == TimerNum::SysClock && (clock_src & 0x2)) {
+        return SystemClockDiv8;
+    }
+    // timer 1 on hblanks counts in progressAt
+    return SystemClock;
+}
+
+/*
+ * Where a counter at value wraps back to 0.
+ */
+u32 limitFrom(u32 timer_num, u32 value)
+{
+    u32 target = s.timer_target[timer_num];
+    if (s.timer_mode[timer_num].fields.reset_mode && value < target) {
+        return target;
+    }
+    return 0x10000;
+}
+
+/*
+ * Values the counter goes through after a wrap.
+ */
+u32 period(u32 timer_num)
+{
+    u32 target = s.timer_target[timer_num];
+    return s.timer_mode[timer_num].fields.reset_mode && target != 0 ? target : 0x10000;
+}
+
+/*
+ * Timer 1 can count hblanks, which come from the gpu instead of the time.
+ */
+bool countsHblanks(u32 timer_num)
+{
+    return timer_num == TimerNum::HorzRetrace && (s.timer_mode[timer_num].fields.clock_src & 0x1);
+}
+
+/*
+ * Progress since the counter's base value, in 1/den cycles.
+ */
+u64 progressAt(u32 timer_num, u64 now)
+{
+    const Counter& counter = s.counters[timer_num];
+    if (counter.paused || countsHblanks(timer_num)) {
+        return counter.phase;
+    }
+    return (now - counter.start) * clockOf(timer_num).den + counter.phase;
+}
+
+u32 valueAfter(u32 timer_num, u64 ticks)
+{
+    u32 base = s.counters[timer_num].base;
+    u32 limit = limitFrom(timer_num, base);
+    if (ticks < limit - base) {
+        return base + static_cast<u32>(ticks);
+    }
+    return static_cast<u32>((ticks - (limit - base)) % period(timer_num));
+}
+
+u32 valueAt(u32 timer_num, u64 now)
+{
+    return valueAfter(timer_num, progressAt(timer_num, now) / clockOf(timer_num).num);
+}
+
+/*
+ * Fold the ticks up to now into the base value, before anything that changes
+ * how the counter counts.
+ */
+void rebase(u32 timer_num, u64 now)
+{
+    Counter& counter = s.counters[timer_num];
+    Clock clock = clockOf(timer_num);
+    u64 progress = progressAt(timer_num, now);
+    counter.base = valueAfter(timer_num, progress / clock.num);
+    counter.phase = static_cast<u32>(progress % clock.num);
+    counter.start = now;
+}
+
+/*
+ * Ticks until a counter at value reaches x, 0 if it never does.
+ */
+u32 ticksUntil(u32 timer_num, u32 value, u32 x)
+{
+    u32 limit = limitFrom(timer_num, value);
+    if (x > value && x <= limit) {
+        return x - value;
+    }
+    // after the wrap, reaching the target in reset mode is the wrap itself
+    if (x <= period(timer_num)) {
+        return limit - value + x;
+    }
+    return 0;
+}
+
+/*
+ * Schedule the match event at the cycle the counter next reaches its target
+ * or 0xffff.
+ */
+void scheduleMatch(u32 timer_num)
+{
+    Counter& counter = s.counters[timer_num];
+    if (counter.paused || countsHblanks(timer_num)) {
+        Scheduler::Cancel(match_events[timer_num]);
         return;
-    } 
-    s.timer_val[TimerNum::SysClock]++;
+    }
+    u32 to_target = ticksUntil(timer_num, counter.base, s.timer_target[timer_num]);
+    u32 to_ffff = ticksUntil(timer_num, counter.base, 0xffff);
+    u32 ticks = to_ffff != 0 && to_ffff < to_target ? to_ffff : to_target;
+    counter.match_target = ticks == to_target;
+    counter.match_ffff = ticks == to_ffff;
+
+    Clock clock = clockOf(timer_num);
+    u64 units = static_cast<u64>(ticks) * clock.num - counter.phase;
+    Scheduler::ScheduleAt(match_events[timer_num], counter.start + (units + clock.den - 1) / clock.den);
 }
 
-void horzRetraceStep()
+void raiseIrq(u32 timer_num)
 {
-    // TODO idk if this timing is good
-    static u32 s_cpu_clock = 0;
-    const u32 cpu_clocks_per_frame = 33'868'800 / 60;
-    const u32 scanlines_per_frame = 263; // NTSC
-    const u16 clk_src = s.timer_mode[TimerNum::HorzRetrace].fields.clock_src;
-    const u32 clocks_before_count = clk_src == 0 || clk_src == 2 
-                                    ? 0 : (cpu_clocks_per_frame / scanlines_per_frame);
-    if (s_cpu_clock++ < clocks_before_count) {
+    Counter& counter = s.counters[timer_num];
+    State::TimerModeReg& mode = s.timer_mode[timer_num];
+    if (counter.irq_done && !mode.fields.irq_repeat) {
         return;
     }
-    s_cpu_clock = 0;
-    PSX_ASSERT(s.timer_mode[TimerNum::HorzRetrace].fields.sync_enable == 0);
-    s.timer_val[TimerNum::HorzRetrace]++;
+    counter.irq_done = true;
+    if (mode.fields.irq_toggle) {
+        mode.fields.irq_disabled = mode.fields.irq_disabled ? 0 : 1;
+        if (mode.fields.irq_disabled) {
+            return;
+        }
+    }
+    // in pulse mode bit 10 is only low for a few cycles, it always reads 1
+
+    Interrupt::Type itype;
+    switch (timer_num) {
+    case TimerNum::Dotclock: itype = Interrupt::Type::Timer0; break;
+    case TimerNum::HorzRetrace: itype = Interrupt::Type::Timer1; break;
+    case TimerNum::SysClock: itype = Interrupt::Type::Timer2; break;
+    default: PSX_ASSERT(0);
+    }
+    Interrupt::Signal(itype);
 }
 
-void dotClockStep()
+/*
+ * The counter just reached its target and/or 0xffff.
+ */
+void matched(u32 timer_num)
+{
+    const Counter& counter = s.counters[timer_num];
+    State::TimerModeReg& mode = s.timer_mode[timer_num];
+    if (counter.match_target) {
+        mode.fields.reached_target = 1;
+    }
+    if (counter.match_ffff) {
+        mode.fields.reached_ffff = 1;
+    }
+    if ((counter.match_target && mode.fields.irq_on_target)
+            || (counter.match_ffff && mode.fields.irq_on_ffff)) {
+        raiseIrq(timer_num);
+    }
+}
+
+template<u32 timer_num>
+void onMatch(u32 cycles_late)
+{
+    (void) cycles_late;
+    rebase(timer_num, Scheduler::Now());
+    matched(timer_num);
+    scheduleMatch(timer_num);
+}
+
+void hblankTick(u32 timer_num)
+{
+    Counter& counter = s.counters[timer_num];
+    counter.match_target = ticksUntil(timer_num, counter.base, s.timer_target[timer_num]) == 1;
+    counter.match_ffff = ticksUntil(timer_num, counter.base, 0xffff) == 1;
+    counter.base = valueAfter(timer_num, 1);
+    if (counter.match_target || counter.match_ffff) {
+        matched(timer_num);
+    }
+}
+
+/*
+ * Pause or resume the counter as its sync mode says.
+ *   Timer 0/1: 0 = pause during blank, 1 = free run (resets at blank),
+ *              2 = pause outside of blank, 3 = pause until the first blank
+ *   Timer 2:   0 or 3 = stop, 1 or 2 = free run
+ */
+void updatePaused(u32 timer_num, u64 now)
 {
-    // TODO idk if this timing is good
-    static u32 s_cpu_clock = 0;
-    const u32 cpu_clocks_per_frame = 33'868'800 / 60;
-    const u32 dots_per_scanline = 853; // NTSC
-    const u32 scanline_per_frame = 263; // NTSC
-    const u32 cpu_clocks_per_dot = cpu_clocks_per_frame / (dots_per_scanline * scanline_per_frame);
-    const u16 clk_src = s.timer_mode[TimerNum::Dotclock].fields.clock_src;
-    const u32 clocks_before_count = clk_src == 0 || clk_src == 2 
-                                    ? 0 : cpu_clocks_per_dot;
-    if (s_cpu_clock++ < clocks_before_count) {
+    const State::TimerModeReg& mode = s.timer_mode[timer_num];
+    bool paused = false;
+    if (mode.fields.sync_enable) {
+        u16 sync_mode = mode.fields.sync_mode;
+        if (timer_num == TimerNum::SysClock) {
+            paused = sync_mode == 0 || sync_mode == 3;
+        } else {
+            bool blank = timer_num == TimerNum::Dotclock ? s.in_hblank : s.in_vblank;
+            paused = (sync_mode == 0 && blank) || (sync_mode == 2 && !blank) || sync_mode == 3;
+        }
+    }
+    Counter& counter = s.counters[timer_num];
+    if (paused != counter.paused) {
+        rebase(timer_num, now);
+        counter.paused = paused;
+    }
+}
+
+void setBlank(u32 timer_num, bool blank)
+{
+    bool& in_blank = timer_num == TimerNum::Dotclock ? s.in_hblank : s.in_vblank;
+    if (in_blank == blank) {
+        return;
+    }
+    in_blank = blank;
+    State::TimerModeReg& mode = s.timer_mode[timer_num];
+    if (!mode.fields.sync_enable) {
         return;
     }
-    s_cpu_clock = 0;
-    PSX_ASSERT(s.timer_mode[TimerNum::Dotclock].fields.sync_enable == 0);
-    s.timer_val[TimerNum::Dotclock]++;
+
+    u64 now = Scheduler::Now();
+    rebase(timer_num, now);
+    if (blank && (mode.fields.sync_mode == 1 || mode.fields.sync_mode == 2)) {
+        s.counters[timer_num].base = 0;
+    } else if (blank && mode.fields.sync_mode == 3) {
+        // switches to free run for good
+        mode.fields.sync_enable = 0;
+    }
+    updatePaused(timer_num, now);
+    scheduleMatch(timer_num);
 }
 
 } // end private ns
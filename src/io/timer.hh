@@ -19,7 +19,11 @@ namespace Timer {
 
 void Init();
 void Reset();
-void Step();
+// blank signals from the video timing for the sync modes
+void SetHblank(bool active);
+void SetVblank(bool active);
+// dot clock divider of the gpu's horizontal resolution
+void SetDotClock(u32 divider);
 void OnActive(bool *active);
 
 template<class T>
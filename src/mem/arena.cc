@@ -0,0 +1,164 @@
+/*
+ * arena.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Keeping all of guest memory in one aligned block means the hot regions
+ * share a couple of huge pages instead of being spread over the heap, a
+ * savestate is one copy, and anything that wants to reach every region
+ * (fastmem, the recompiler) only needs the one base pointer.
+ *
+ * On Linux the arena is a memfd so fastmem can map it into its view of the
+ * guest address space. Everywhere else it's static storage.
+ */
+
+#include "mem/arena.hh"
+
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define ARENA_INFO(...) PSXLOG_INFO("Arena", __VA_ARGS__)
+#define ARENA_WARN(...) PSXLOG_WARN("Arena", __VA_ARGS__)
+#define ARENA_ERROR(...) PSXLOG_ERROR("Arena", __VA_ARGS__)
+
+// *** Private Data and Helpers ***
+namespace  {
+struct State {
+    u8 *base = nullptr;
+    int fd = -1;
+} s;
+
+// used when nothing better can be mapped
+alignas(4096) u8 fallback_arena[Psx::Arena::Size];
+
+#ifdef __linux__
+/*
+ * Map the arena from a memfd. Returns false if that isn't possible.
+ */
+bool mapShared(bool transparent_huge_pages)
+{
+    int fd = memfd_create("psx-guest-mem", MFD_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, Psx::Arena::Size) != 0) {
+        close(fd);
+        return false;
+    }
+    void *mem = mmap(nullptr, Psx::Arena::Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+    if (transparent_huge_pages && madvise(mem, Psx::Arena::Size, MADV_HUGEPAGE) != 0) {
+        ARENA_INFO("Transparent huge pages not available for the arena");
+    }
+    s.base = static_cast<u8*>(mem);
+    s.fd = fd;
+    return true;
+}
+
+/*
+ * Map the arena from reserved huge pages. Returns false if there aren't
+ * enough of them.
+ */
+bool mapHugeTlb()
+{
+    void *mem = mmap(nullptr, Psx::Arena::Size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+    s.base = static_cast<u8*>(mem);
+    return true;
+}
+#endif
+}// end namespace
+
+namespace Psx {
+namespace Arena {
+
+/*
+ * Allocate the arena. Needs to happen before anything that keeps a pointer
+ * into guest memory is initialized. Does nothing after the first call.
+ */
+void Init(HugePages huge_pages)
+{
+    if (s.base != nullptr) {
+        return;
+    }
+    ARENA_INFO("Initializing {}KB of guest memory", Size / 1024);
+#ifdef __linux__
+    if (huge_pages == HugePages::HugeTlb) {
+        if (mapHugeTlb()) {
+            return;
+        }
+        ARENA_WARN("No huge pages reserved for the arena, falling back to transparent huge pages");
+        huge_pages = HugePages::Transparent;
+    }
+    if (mapShared(huge_pages == HugePages::Transparent)) {
+        return;
+    }
+    ARENA_WARN("Failed to map the arena, falling back to static memory");
+#else
+    (void) huge_pages;
+#endif
+    s.base = fallback_arena;
+}
+
+u8* Base()
+{
+    return s.base;
+}
+
+int Fd()
+{
+    return s.fd;
+}
+
+/*
+ * Map the start of a file read-only over a region of the arena, so every
+ * process using the same file shares the same physical pages. Only possible
+ * when the arena is a memfd, returns false otherwise.
+ */
+bool MapFile(u32 offset, u32 size, int fd)
+{
+#ifdef __linux__
+    if (s.fd < 0) {
+        return false;
+    }
+    return mmap(s.base + offset, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED;
+#else
+    (void) offset;
+    (void) size;
+    (void) fd;
+    return false;
+#endif
+}
+
+/*
+ * Put the arena's own writable memory back under a region after MapFile.
+ */
+void UnmapFile(u32 offset, u32 size)
+{
+#ifdef __linux__
+    if (s.fd < 0) {
+        return;
+    }
+    if (mmap(s.base + offset, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, s.fd, offset) == MAP_FAILED) {
+        ARENA_ERROR("Failed to restore arena region at 0x{:x}", offset);
+        throw std::runtime_error("Failed to restore arena region");
+    }
+#else
+    (void) offset;
+    (void) size;
+#endif
+}
+
+}// end namespace
+}
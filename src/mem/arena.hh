@@ -0,0 +1,54 @@
+/*
+ * arena.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * One host allocation holding all guest memory (RAM, BIOS, scratchpad and
+ * VRAM) at fixed offsets.
+ */
+
+#pragma once
+
+#include "util/psxutil.hh"
+
+namespace Psx {
+namespace Arena {
+
+// every region starts on a 4KB page
+constexpr u32 RamOffset = 0x00'0000;
+constexpr u32 RamSize = 2 * 1024 * 1024;
+constexpr u32 BiosOffset = 0x20'0000;
+constexpr u32 BiosSize = 512 * 1024;
+constexpr u32 ScratchpadOffset = 0x28'0000;
+constexpr u32 ScratchpadSize = 1024;
+constexpr u32 VramOffset = 0x30'0000;
+constexpr u32 VramSize = 1024 * 1024;
+// two 2MB huge pages
+constexpr u32 Size = 0x40'0000;
+
+enum class HugePages {
+    Off,
+    // ask for transparent huge pages, the kernel may still use 4KB pages
+    Transparent,
+    // reserved huge pages, can't be mapped by fastmem
+    HugeTlb,
+};
+
+void Init(HugePages huge_pages = HugePages::Transparent);
+u8* Base();
+// file backing the arena so it can be mapped again elsewhere, -1 if there
+// isn't one
+int Fd();
+
+// map part of a file read-only over a region, and undo it
+bool MapFile(u32 offset, u32 size, int fd);
+void UnmapFile(u32 offset, u32 size);
+
+inline u8* RamBase() { return Base() + RamOffset; }
+inline u8* BiosBase() { return Base() + BiosOffset; }
+inline u8* ScratchpadBase() { return Base() + ScratchpadOffset; }
+inline u8* VramBase() { return Base() + VramOffset; }
+
+}// end namespace
+}
@@ -9,6 +9,7 @@
  * write to the bus without caring about which HW device is the target.
  */
 
+#include <array>
 #include <type_traits>
 
 #include "fmt/core.h"
@@ -20,20 +21,108 @@
 #include "mem/memcontrol.hh"
 #include "mem/scratchpad.hh"
 #include "mem/dma.hh"
+#include "mem/fastmem.hh"
 #include "view/imgui/dbgmod.hh"
 #include "view/imgui/imgui_layer.hh"
 #include "gpu/gpu.hh"
 #include "io/timer.hh"
 #include "cpu/interrupt.hh"
+#include "cpu/icache.hh"
 
 #define BUS_INFO(...) PSXLOG_INFO("Bus", __VA_ARGS__)
 #define BUS_WARN(...) PSXLOG_WARN("Bus", __VA_ARGS__)
 #define BUS_ERROR(...) PSXLOG_ERROR("Bus", __VA_ARGS__)
 
+// the address space is split into 64KB pages for dispatch
+constexpr u32 PageBits = 16;
+constexpr u32 PageSize = 1u << PageBits;
+constexpr u32 NumPages = 1u << (32 - PageBits);
+
+constexpr u32 RamSize = 2 * 1024 * 1024;
+// RAM is mirrored 4 times in each segment
+constexpr u32 RamWindow = 8 * 1024 * 1024;
+constexpr u32 BiosSize = 512 * 1024;
+constexpr u32 ScratchpadSize = 1024;
+
 // *** Private Helpers and Data ***
 namespace {
 
-bool inline inRangeMemControl(u32 addr);
+enum class Region : u8 {
+    Unmapped,
+    Ram,
+    Bios,
+    // scratchpad in the first 1KB, memory mapped io above it
+    Scratchpad,
+    // memory mapped io, too fine grained for pages
+    Io,
+    // RAM while the cache is isolated, writes go to the cache instead
+    IsolatedCache,
+};
+
+struct State {
+    // host memory backing each page for reads, nullptr if reads need to go
+    // through the device
+    std::array<const u8*, NumPages> read_pages{};
+    std::array<Region, NumPages> regions{};
+    u8 *scratchpad = nullptr;
+    bool cache_isolated = false;
+} s;
+
+void mapPages(u32 base, u32 size, Region region, const u8 *host = nullptr, u32 host_size = 0)
+{
+    for (u32 off = 0; off < size; off += PageSize) {
+        u32 page = (base + off) >> PageBits;
+        s.regions[page] = region;
+        s.read_pages[page] = host == nullptr ? nullptr : host + (off & (host_size - 1));
+    }
+}
+
+// registers in the io window at 0x1f80'1000, dispatched through a table
+// indexed by word offset
+constexpr u32 IoBase = 0x1f80'1000;
+constexpr u32 IoSize = 4 * 1024;
+
+template<class T>
+struct IoHandler {
+    T (*read)(u32 addr) = nullptr;
+    void (*write)(T data, u32 addr) = nullptr;
+};
+
+template<class T>
+using IoTable = std::array<IoHandler<T>, IoSize / 4>;
+
+/*
+ * Build the io dispatch table for one access width. New devices register
+ * their address ranges here.
+ */
+template<class T>
+constexpr IoTable<T> makeIoTable()
+{
+    using namespace Psx;
+    IoTable<T> table{};
+    auto map = [&table] (u32 start, u32 end, IoHandler<T> handler) {
+        for (u32 addr = start; addr < end; addr += 4) {
+            table[(addr - IoBase) >> 2] = handler;
+        }
+    };
+    map(0x1f80'1000, 0x1f80'1024, {MemControl::Read<T>, MemControl::Write<T>});
+    map(0x1f80'1060, 0x1f80'1064, {MemControl::Read<T>, MemControl::Write<T>}); // RAM_SIZE
+    map(0x1f80'1070, 0x1f80'1078, {Interrupt::Read<T>, Interrupt::Write<T>});
+    map(0x1f80'1080, 0x1f80'10fc, {Dma::Read<T>, Dma::Write<T>});
+    map(0x1f80'1100, 0x1f80'112c, {Timer::Read<T>, Timer::Write<T>});
+    map(0x1f80'1810, 0x1f80'1818, {Gpu::Read<T>, Gpu::Write<T>});
+    return table;
+}
+
+template<class T>
+constexpr IoTable<T> io_table = makeIoTable<T>();
+
+template<class T>
+bool ioRead(u32 addr, T& data);
+template<class T>
+bool ioWrite(T data, u32 addr);
+template<class T>
+void cacheWrite(T data, u32 addr);
 
 }
 
@@ -41,82 +130,77 @@ namespace Psx {
 namespace Bus {
 
 // *** State Modifiers ***
+/*
+ * Build the page table. Needs to happen after the memory devices are
+ * initialized since it holds pointers to their storage.
+ */
 void Init()
 {
     BUS_INFO("Initializing state");
+    s.read_pages.fill(nullptr);
+    s.regions.fill(Region::Unmapped);
+    s.cache_isolated = false;
+    for (u32 seg : {0x0000'0000u, 0x8000'0000u, 0xa000'0000u}) {
+        mapPages(seg, RamWindow, Region::Ram, Ram::HostPtr(), RamSize);
+        mapPages(seg + 0x1fc0'0000, BiosSize, Region::Bios, Bios::HostPtr(), BiosSize);
+    }
+    // not in kseg1, see IsBusError
+    s.scratchpad = Scratchpad::HostPtr();
+    mapPages(0x1f80'0000, PageSize, Region::Scratchpad);
+    mapPages(0x9f80'0000, PageSize, Region::Scratchpad);
+    // cache control
+    mapPages(0xfffe'0000, PageSize, Region::Io);
 }
 
 void Reset()
 {
+}
 
+/*
+ * Called by Cop0 when the isolate cache bit in SR changes. Remaps RAM so
+ * that writes go to the cache instead, which keeps the check out of every
+ * RAM write. Reads still come from RAM. Scratchpad and io writes through
+ * kuseg and kseg0 are dropped too, checked on their (slower) path.
+ */
+void SetCacheIsolated(bool isolated)
+{
+    if (isolated == s.cache_isolated) {
+        return;
+    }
+    s.cache_isolated = isolated;
+    // isolation has always dropped RAM writes in all three segments
+    for (u32 seg : {0x0000'0000u, 0x8000'0000u, 0xa000'0000u}) {
+        mapPages(seg, RamWindow, isolated ? Region::IsolatedCache : Region::Ram, Ram::HostPtr(), RamSize);
+    }
+    Fastmem::SetCacheIsolated(isolated);
 }
 
 // *** Reads ***
 template<class T>
 T Read(u32 addr, Bus::RWVerbosity verb)
 {
-    // Helpers
-    auto inRange = [] (u32 base, u32 size, u32 addr) {
-        return addr >= base && addr < (base + size);
-    };
-
     // check for breakpoint
 #ifdef PSX_DEBUG
     using namespace View::ImGuiLayer::DbgMod;
     Breakpoints::Saw<Breakpoints::BrkType::ReadWatch>(addr);
 #endif
 
-    // Main RAM
-    constexpr u32 ram_size = 8 * 1024 * 1024; // 8 MB
-    if (inRange(0x0000'0000, ram_size, addr) // KUSEG
-     || inRange(0x8000'0000, ram_size, addr) // KSEG0
-     || inRange(0xa000'0000, ram_size, addr))// KSEG1
-    {
-        return Ram::Read<T>(addr);
-    }
-
-    // BIOS
-    constexpr u32 bios_size = 512 * 1024;
-    if (inRange(0x1fc0'0000, bios_size, addr) // KUSEG
-     || inRange(0x9fc0'0000, bios_size, addr) // KSEG0
-     || inRange(0xbfc0'0000, bios_size, addr))// KSEG1
-    {
-        return Bios::Read<T>(addr);
-    }
-
-    // GPU
-    if (addr == 0x1f80'1810 || addr == 0x1f80'1814) {
-        return Gpu::Read<T>(addr);
-    }
-
-    // Scratchpad
-    constexpr u32 sp_size = 1 * 1024;
-    if (inRange(0x1f80'0000, sp_size, addr) // KUSEG
-     || inRange(0x9f80'0000, sp_size, addr))// KSEG0
-    {
-        return Scratchpad::Read<T>(addr);
-    }
-
-    // DMA
-    constexpr u32 dma_size = (0x1f80'10fc - 0x1f80'1080);
-    if (inRange(0x1f80'1080, dma_size, addr)) {
-        return Dma::Read<T>(addr);
+    // RAM and BIOS
+    u32 page = addr >> PageBits;
+    if (const u8 *host = s.read_pages[page]) {
+        return Util::LoadLE<T>(host + (addr & (PageSize - 1)));
     }
 
-    // interrupts
-    if (addr == 0x1f80'1070 || addr == 0x1f80'1074) {
-        return Interrupt::Read<T>(addr);
+    // the scratchpad is one compare away from the RAM path
+    Region region = s.regions[page];
+    u32 offset = addr & (PageSize - 1);
+    if (region == Region::Scratchpad && offset < ScratchpadSize) {
+        return Util::LoadLE<T>(s.scratchpad + offset);
     }
 
-    // Timers
-    constexpr u32 timer_size = (0x1f80'112c - 0x1f80'1100);
-    if (inRange(0x1f80'1100, timer_size, addr)) {
-        return Timer::Read<T>(addr);
-    }
-
-    // Memory Control Register
-    if (inRangeMemControl(addr)) {
-        return MemControl::Read<T>(addr);
+    T data = 0;
+    if ((region == Region::Io || region == Region::Scratchpad) && ioRead<T>(addr, data)) {
+        return data;
     }
 
     if constexpr (std::is_same_v<T, u8>) {
@@ -143,85 +227,44 @@ template u32 Read<u32>(u32 addr, Bus::RWVerbosity verb);
 template<class T>
 void Write(T data, u32 addr, Bus::RWVerbosity verb)
 {
-    // Helpers
-    auto inRange = [] (u32 base, u32 size, u32 addr) {
-        return addr >= base && addr < (base + size);
-    };
-
     // check for breakpoint
 #ifdef PSX_DEBUG
     using namespace View::ImGuiLayer::DbgMod;
     Breakpoints::Saw<Breakpoints::BrkType::WriteWatch>(addr);
 #endif
 
-    // Main RAM
-    constexpr u32 ram_size = 8 * 1024 * 1024; // 8 MB
-    if (inRange(0x0000'0000, ram_size, addr) // KUSEG
-     || inRange(0x8000'0000, ram_size, addr) // KSEG0
-     || inRange(0xa000'0000, ram_size, addr))// KSEG1
-    {
+    switch (s.regions[addr >> PageBits]) {
+    case Region::Scratchpad:
+        if (s.cache_isolated) {
+            cacheWrite<T>(data, addr);
+            return;
+        }
+        if ((addr & (PageSize - 1)) < ScratchpadSize) {
+            Util::StoreLE<T>(s.scratchpad + (addr & (PageSize - 1)), data);
+            return;
+        }
+        if (ioWrite<T>(data, addr)) {
+            return;
+        }
+        break;
+    case Region::Ram:
+        // goes through Ram for code invalidation
         Ram::Write<T>(data, addr);
         return;
-    }
-
-    // BIOS
-    constexpr u32 bios_size = 512 * 1024;
-    if (inRange(0x1fc0'0000, bios_size, addr) // KUSEG
-     || inRange(0x9fc0'0000, bios_size, addr) // KSEG0
-     || inRange(0xbfc0'0000, bios_size, addr))// KSEG1
-    {
-        Bios::Write<T>(data, addr);
-        return;
-    }
-
-    // GPU
-    if (addr == 0x1f80'1810 || addr == 0x1f80'1814) {
-        Gpu::Write<T>(data, addr);
-        return;
-    }
-
-    // Scratchpad
-    constexpr u32 sp_size = 1 * 1024;
-    if (inRange(0x1f80'0000, sp_size, addr) // KUSEG
-     || inRange(0x9f80'0000, sp_size, addr))// KSEG0
-    {
-        Scratchpad::Write<T>(data, addr);
-        return;
-    }
-
-    // DMA
-    constexpr u32 dma_size = (0x1f80'10fc - 0x1f80'1080);
-    if (inRange(0x1f80'1080, dma_size, addr)) {
-        Dma::Write<T>(data, addr);
-        return;
-    }
-
-    // interrupts
-    if (addr == 0x1f80'1070 || addr == 0x1f80'1074) {
-        Interrupt::Write<T>(data, addr);
+    case Region::IsolatedCache:
+        cacheWrite<T>(data, addr);
         return;
-    }
-
-    // Timers
-    constexpr u32 timer_size = (0x1f80'112c - 0x1f80'1100);
-    if (inRange(0x1f80'1100, timer_size, addr)) {
-        Timer::Write<T>(data, addr);
-        return;
-    }
-
-    // Memory Control Register
-    if (inRangeMemControl(addr)) {
-        MemControl::Write<T>(data, addr);
-        return;
-    }
-
-#ifdef PSX_DEBUG
-    // POST (not really important, but useful for debug)
-    if (addr == 0x1f80'2041) {
-        BUS_INFO("POST = 0x{:02x}", data);
+    case Region::Bios:
+        Bios::Write<T>(data, addr);
         return;
+    case Region::Io:
+        if (ioWrite<T>(data, addr)) {
+            return;
+        }
+        break;
+    case Region::Unmapped:
+        break;
     }
-#endif
 
     if constexpr (std::is_same_v<T, u8>) {
         if (verb != RWVerbosity::Quiet)
@@ -245,12 +288,70 @@ template void Write<u32>(u32 data, u32 addr, Bus::RWVerbosity verb);
 }
 
 namespace {
+using namespace Psx;
 
-bool inline inRangeMemControl(u32 addr)
+/*
+ * Read from an io device. Returns false if nothing is mapped at the address.
+ */
+template<class T>
+bool ioRead(u32 addr, T& data)
 {
-    return (addr >= 0x1f80'1000 && addr <= 0x1f80'1020) || addr == 0x1f80'1060 || addr == 0xfffe'0130;
+    if (addr - IoBase < IoSize) {
+        const IoHandler<T>& handler = io_table<T>[(addr - IoBase) >> 2];
+        if (handler.read == nullptr) {
+            return false;
+        }
+        data = handler.read(addr);
+        return true;
+    }
+
+    // Cache Control
+    if (addr == 0xfffe'0130) {
+        data = MemControl::Read<T>(addr);
+        return true;
+    }
+    return false;
 }
 
-}// end namespace
+/*
+ * Write to an io device. Returns false if nothing is mapped at the address.
+ */
+template<class T>
+bool ioWrite(T data, u32 addr)
+{
+    if (addr - IoBase < IoSize) {
+        const IoHandler<T>& handler = io_table<T>[(addr - IoBase) >> 2];
+        if (handler.write == nullptr) {
+            return false;
+        }
+        handler.write(data, addr);
+        return true;
+    }
+
+    // Cache Control
+    if (addr == 0xfffe'0130) {
+        MemControl::Write<T>(data, addr);
+        return true;
+    }
+
+#ifdef PSX_DEBUG
+    // POST (not really important, but useful for debug)
+    if (addr == 0x1f80'2041) {
+        BUS_INFO("POST = 0x{:02x}", data);
+        return true;
+    }
+#endif
+    return false;
+}
 
+/*
+ * Store while the cache is isolated. These only reach the i-cache, which the
+ * BIOS uses to flush it by writing to every cache line.
+ */
+template<class T>
+void cacheWrite(T data, u32 addr)
+{
+    Cpu::ICache::Write<T>(data, addr);
+}
 
+}// end namespace
@@ -22,7 +22,17 @@ enum class RWVerbosity {
 // State Modifiers
 void Init();
 void Reset();
+void SetCacheIsolated(bool isolated);
 
+/*
+ * Returns true if an access to addr gets a bus error instead of reaching a
+ * device. The scratchpad is only wired to the cached segments, so its kseg1
+ * mirror has nothing behind it. Checked by the CPU before loads and stores.
+ */
+inline bool IsBusError(u32 addr)
+{
+    return (addr & 0xffff'fc00) == 0xbf80'0000;
+}
 
 // Reads
 template<class T>
@@ -14,6 +14,7 @@
 
 #include "imgui/imgui.h"
 
+#include "core/scheduler.hh"
 #include "mem/ram.hh"
 #include "gpu/gpu.hh"
 
@@ -145,6 +146,9 @@ struct State {
     std::queue<u8> dma_queue;
 } s;
 
+// outside of the state so it survives resets
+Psx::Scheduler::EventHandle transfer_event;
+
 enum class Channel {
     Ch0 = 0,
     Ch1 = 1,
@@ -159,6 +163,8 @@ enum class Channel {
 u32* getRegRef(u32 addr);
 void doDma(uint channel);
 bool dmaReady(u32 channel);
+bool masterEnabled(u32 channel);
+void runQueued(u32 cycles_late);
 // template<class channel> void doBlockDma(uint chnum);
 
 }// end ns
@@ -170,6 +176,7 @@ namespace Dma {
 void Init()
 {
     DMA_INFO("Initializing state");
+    transfer_event = Scheduler::Register("DMA Transfer", runQueued);
     Reset();
 }
 
@@ -179,65 +186,6 @@ void Reset()
     s.regs = {};
 }
 
-void Step()
-{
-
-    // queue system
-    if (s.dma_queue.size() > 0) {
-        u8 channel = s.dma_queue.front();
-
-        // if master bit not enabled, wait until it is
-        if (!Util::GetBits(s.regs.dpcr, 3u + ((uint)channel << 2), 1)) {
-            return;
-        }
-
-        DMA_INFO("[CH{}] Starting DMA", channel);
-        if (Util::GetBits(s.regs.channels[channel].chcr, 8, 1)) {
-            DMA_ERROR("No support for DMA Chopping mode");
-            PSX_ASSERT(0);
-        }
-
-        // clear start/trigger bit
-        Util::SetBits(s.regs.channels[channel].chcr, 28, 1, 0);
-        doDma(channel);
-        // clear start/busy bit
-        Util::SetBits(s.regs.channels[channel].chcr, 24, 1, 0);
-
-        // TODO: Do we clear after dma is complete?
-        Util::SetBits(s.regs.dpcr, 3u + ((uint)channel << 2), 1, 0);
-
-        // TODO: do stuff with interrupt bits
-        DMA_INFO("[CH{}] Finished DMA", channel);
-
-        s.dma_queue.pop();
-    }
-
-    // TODO handle priority
-    // TODO: maybe switch to queue system to improve performance
-    // for (u32 channel = 0; channel < 7; channel++) {
-    //     if (dmaReady(channel)) {
-    //         DMA_INFO("[CH{}] Starting DMA", channel);
-    //         if (Util::GetBits(s.regs.channels[channel].chcr, 8, 1)) {
-    //             DMA_ERROR("No support for DMA Chopping mode");
-    //             PSX_ASSERT(0);
-    //         }
-
-    //         // clear start/trigger bit
-    //         Util::SetBits(s.regs.channels[channel].chcr, 28, 1, 0);
-    //         doDma(channel);
-    //         // clear start/busy bit
-    //         Util::SetBits(s.regs.channels[channel].chcr, 24, 1, 0);
-
-    //         // TODO: Do we clear after dma is complete?
-    //         Util::SetBits(s.regs.dpcr, 3u + (channel << 2), 1, 0);
-
-    //         // TODO: do stuff with interrupt bits
-    //         DMA_INFO("[CH{}] Finished DMA", channel);
-    //         break; // only do at most 1 dma request
-    //     }
-    // }
-}
-
 // *** Read ***
 template<class T>
 T Read(u32 addr)
@@ -294,7 +242,12 @@ void Write(T data, u32 addr)
                 u32 chnum = ((addr >> 4) & 0xf) - 0x8;
                 if (dmaReady(chnum)) {
                     s.dma_queue.push(chnum);
+                    // let the transfer start before the cpu carries on
+                    Scheduler::Schedule(transfer_event, 0);
                 }
+            } else if (addr == 0x1f80'10f0 && s.dma_queue.size() > 0) {
+                // may have enabled the channel waiting at the front
+                Scheduler::Schedule(transfer_event, 0);
             }
         }
     } else {
@@ -423,6 +376,8 @@ void doBlockDma()
     bool increment = !Util::GetBits(s.regs.channels[chnum].chcr, 1, 1);
     u32 num_words = s.regs.channels[chnum].bcr & 0xffff;
     if (num_words == 0) num_words = 0x1'0000;
+    // DMA only reaches main RAM, a MADR pointing at the scratchpad wraps
+    // around into RAM like it does on hardware
     u32 base_addr = s.regs.channels[chnum].madr & 0x00ff'ffff;
     u32 sync_mode = Util::GetBits(s.regs.channels[2].chcr, 9, 2);
 
@@ -552,4 +507,51 @@ bool dmaReady(u32 channel)
     return true;
 }
 
+bool masterEnabled(u32 channel)
+{
+    return Util::GetBits(s.regs.dpcr, 3u + (channel << 2), 1);
+}
+
+/*
+ * Run the transfer at the front of the queue once its channel's master
+ * enable is set.
+ */
+void runQueued(u32 cycles_late)
+{
+    (void) cycles_late;
+    // queue system
+    if (s.dma_queue.size() > 0) {
+        u8 channel = s.dma_queue.front();
+
+        // if master bit not enabled, wait until it is
+        if (!masterEnabled(channel)) {
+            return;
+        }
+
+        DMA_INFO("[CH{}] Starting DMA", channel);
+        if (Util::GetBits(s.regs.channels[channel].chcr, 8, 1)) {
+            DMA_ERROR("No support for DMA Chopping mode");
+            PSX_ASSERT(0);
+        }
+
+        // clear start/trigger bit
+        Util::SetBits(s.regs.channels[channel].chcr, 28, 1, 0);
+        doDma(channel);
+        // clear start/busy bit
+        Util::SetBits(s.regs.channels[channel].chcr, 24, 1, 0);
+
+        // TODO: Do we clear after dma is complete?
+        Util::SetBits(s.regs.dpcr, 3u + (static_cast<u32>(channel) << 2), 1, 0);
+
+        // TODO: do stuff with interrupt bits
+        DMA_INFO("[CH{}] Finished DMA", channel);
+
+        s.dma_queue.pop();
+        // one transfer at a time, the next one starts right after
+        if (s.dma_queue.size() > 0) {
+            Scheduler::Schedule(transfer_event, 0);
+        }
+    }
+}
+
 }// end ns
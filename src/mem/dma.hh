@@ -17,7 +17,6 @@ namespace Dma {
 
 void Init();
 void Reset();
-void Step();
 void OnActive(bool *active);
 
 template<class T> T Read(u32 addr);
@@ -0,0 +1,335 @@
+/*
+ * fastmem.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Reserves 4GB of host address space and maps guest memory into it at the
+ * guest addresses, so guest address + view base is the host address. Main
+ * RAM gets mapped from the arena (see arena.hh) at all of its mirrors in
+ * kuseg, kseg0 and kseg1. The BIOS is mapped read-only. The scratchpad is
+ * mapped in kuseg and kseg0 only, as a whole 4KB page, so the 3KB past it
+ * read and write arena padding where the bus would ignore them. Everything
+ * else (io, the kseg1 scratchpad, unmapped space) is left inaccessible, and
+ * the SIGSEGV handler hands those faults to whoever set the fault handler
+ * (the recompiler) to be redirected to the slow path.
+ *
+ * Only supported on x86-64 Linux with a shared arena, everywhere else
+ * IsEnabled() is false.
+ */
+
+#include "mem/fastmem.hh"
+#include "mem/arena.hh"
+
+#include <bitset>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__linux__) && defined(__x86_64__)
+#define PSX_FASTMEM
+#include <signal.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include <unistd.h>
+#endif
+
+#define FM_INFO(...) PSXLOG_INFO("Fastmem", __VA_ARGS__)
+#define FM_WARN(...) PSXLOG_WARN("Fastmem", __VA_ARGS__)
+#define FM_ERROR(...) PSXLOG_ERROR("Fastmem", __VA_ARGS__)
+
+constexpr u64 ViewSize = 1ull << 32;
+constexpr u32 RamSize = Psx::Arena::RamSize;
+constexpr u32 RamWindow = 8 * 1024 * 1024;
+constexpr u32 PageSize = 4 * 1024;
+constexpr u32 NumRamPages = RamSize / PageSize;
+constexpr u32 Segments[] = {0x0000'0000, 0x8000'0000, 0xa000'0000};
+constexpr u32 ScratchpadWindows[] = {0x1f80'0000, 0x9f80'0000};
+
+// *** Private Data and Helpers ***
+namespace  {
+struct State {
+    bool enabled = false;
+    u8 *view = nullptr;
+    Psx::Fastmem::FaultHandler fault_handler = nullptr;
+    bool isolated = false;
+    std::bitset<NumRamPages> code_pages;
+    std::bitset<NumRamPages> tracked_pages;
+#ifdef PSX_FASTMEM
+    struct sigaction old_action;
+#endif
+} s;
+
+#ifdef PSX_FASTMEM
+/*
+ * Set the protection of a range of RAM at every mirror in the view.
+ */
+void protectRam(u32 offset, u32 size, bool writable)
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    for (u32 seg : Segments) {
+        for (u32 mirror = 0; mirror < RamWindow; mirror += RamSize) {
+            mprotect(s.view + seg + mirror + offset, size, prot);
+        }
+    }
+}
+
+/*
+ * Scratchpad writes are dropped while the cache is isolated, nothing else
+ * needs to see them.
+ */
+void protectScratchpad(bool writable)
+{
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    for (u32 window : ScratchpadWindows) {
+        mprotect(s.view + window, PageSize, prot);
+    }
+}
+
+/*
+ * Writes to a page only go straight to memory when nobody needs to see them.
+ */
+bool isWritable(u32 page)
+{
+    return !s.isolated && !s.code_pages[page] && !s.tracked_pages[page];
+}
+
+/*
+ * Reapply the protection of a range of pages, one mprotect per run of pages
+ * that end up the same.
+ */
+void updatePages(u32 first, u32 count)
+{
+    u32 start = first;
+    for (u32 page = first + 1; page <= first + count; page++) {
+        if (page == first + count || isWritable(page) != isWritable(start)) {
+            protectRam(start * PageSize, (page - start) * PageSize, isWritable(start));
+            start = page;
+        }
+    }
+}
+
+void segvHandler(int sig, siginfo_t *info, void *context)
+{
+    u8 *addr = static_cast<u8*>(info->si_addr);
+    if (s.fault_handler != nullptr && addr >= s.view && addr < s.view + ViewSize) {
+        auto *uc = static_cast<ucontext_t*>(context);
+        uintptr_t pc = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+        if (s.fault_handler(pc, static_cast<u32>(addr - s.view))) {
+            uc->uc_mcontext.gregs[REG_RIP] = static_cast<greg_t>(pc);
+            return;
+        }
+    }
+    // not ours, let the faulting instruction run again with the old handler
+    sigaction(sig, &s.old_action, nullptr);
+}
+
+bool mapView()
+{
+    if (sysconf(_SC_PAGESIZE) != static_cast<long>(PageSize)) {
+        FM_WARN("Host page size isn't 4KB, fastmem disabled");
+        return false;
+    }
+    int fd = Psx::Arena::Fd();
+    if (fd < 0) {
+        FM_WARN("Guest memory can't be mapped again, fastmem disabled");
+        return false;
+    }
+
+    void *view = mmap(nullptr, ViewSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    bool ok = view != MAP_FAILED;
+    for (u32 seg : Segments) {
+        for (u32 mirror = 0; ok && mirror < RamWindow; mirror += RamSize) {
+            ok = mmap(static_cast<u8*>(view) + seg + mirror, RamSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_FIXED, fd, Psx::Arena::RamOffset) != MAP_FAILED;
+        }
+        ok = ok && mmap(static_cast<u8*>(view) + seg + 0x1fc0'0000, Psx::Arena::BiosSize, PROT_READ,
+            MAP_SHARED | MAP_FIXED, fd, Psx::Arena::BiosOffset) != MAP_FAILED;
+    }
+    for (u32 window : ScratchpadWindows) {
+        ok = ok && mmap(static_cast<u8*>(view) + window, PageSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_FIXED, fd, Psx::Arena::ScratchpadOffset) != MAP_FAILED;
+    }
+    if (!ok) {
+        FM_WARN("Failed to map the guest address space, fastmem disabled");
+        if (view != MAP_FAILED) {
+            munmap(view, ViewSize);
+        }
+        return false;
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = segvHandler;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGSEGV, &action, &s.old_action);
+
+    s.view = static_cast<u8*>(view);
+    return true;
+}
+#endif
+}// end namespace
+
+namespace Psx {
+namespace Fastmem {
+
+/*
+ * Set up the view. Needs to happen after Arena::Init. Does nothing after
+ * the first call.
+ */
+void Init()
+{
+#ifdef PSX_FASTMEM
+    if (s.view != nullptr) {
+        return;
+    }
+    FM_INFO("Initializing state");
+    s.enabled = mapView();
+#else
+    FM_INFO("Fastmem not supported on this host");
+#endif
+}
+
+bool IsEnabled()
+{
+    return s.enabled;
+}
+
+/*
+ * Host address of guest address 0.
+ */
+u8* Base()
+{
+    return s.view;
+}
+
+void SetFaultHandler(FaultHandler handler)
+{
+    s.fault_handler = handler;
+}
+
+/*
+ * Point the BIOS windows at a file mapped over the arena (see
+ * Arena::MapFile), since the view wouldn't see that mapping otherwise.
+ */
+void MapBios(int fd)
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled) {
+        return;
+    }
+    off_t offset = fd < 0 ? Psx::Arena::BiosOffset : 0;
+    if (fd < 0) {
+        fd = Psx::Arena::Fd();
+    }
+    for (u32 seg : Segments) {
+        if (mmap(s.view + seg + 0x1fc0'0000, Psx::Arena::BiosSize, PROT_READ, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+            FM_ERROR("Failed to map the BIOS into the view");
+            throw std::runtime_error("Failed to map the BIOS into the view");
+        }
+    }
+#else
+    (void) fd;
+#endif
+}
+
+/*
+ * Writes to RAM and the scratchpad are dropped while the cache is isolated,
+ * so make them read-only to send the writes through the bus.
+ */
+void SetCacheIsolated(bool isolated)
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || isolated == s.isolated) {
+        return;
+    }
+    s.isolated = isolated;
+    updatePages(0, NumRamPages);
+    protectScratchpad(!isolated);
+#else
+    (void) isolated;
+#endif
+}
+
+/*
+ * The page holds cached code, writes need to go through Ram::Write so the
+ * code gets invalidated.
+ */
+void ProtectCode(u32 ram_page)
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || s.code_pages[ram_page]) {
+        return;
+    }
+    s.code_pages[ram_page] = true;
+    updatePages(ram_page, 1);
+#else
+    (void) ram_page;
+#endif
+}
+
+void UnprotectCode(u32 ram_page)
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || !s.code_pages[ram_page]) {
+        return;
+    }
+    s.code_pages[ram_page] = false;
+    updatePages(ram_page, 1);
+#else
+    (void) ram_page;
+#endif
+}
+
+void UnprotectAllCode()
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || s.code_pages.none()) {
+        return;
+    }
+    s.code_pages.reset();
+    updatePages(0, NumRamPages);
+#endif
+}
+
+/*
+ * Make writes to every page fault until UntrackWrites is called for it, so
+ * Ram sees the first write to each page (see Ram::TakeDirtyPages).
+ */
+void TrackAllWrites()
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || s.tracked_pages.all()) {
+        return;
+    }
+    s.tracked_pages.set();
+    updatePages(0, NumRamPages);
+#endif
+}
+
+void UntrackWrites(u32 ram_page)
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || !s.tracked_pages[ram_page]) {
+        return;
+    }
+    s.tracked_pages[ram_page] = false;
+    updatePages(ram_page, 1);
+#else
+    (void) ram_page;
+#endif
+}
+
+void UntrackAllWrites()
+{
+#ifdef PSX_FASTMEM
+    if (!s.enabled || s.tracked_pages.none()) {
+        return;
+    }
+    s.tracked_pages.reset();
+    updatePages(0, NumRamPages);
+#endif
+}
+
+}// end namespace
+}
@@ -0,0 +1,45 @@
+/*
+ * fastmem.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Host virtual memory view of the whole guest address space, so recompiled
+ * code can access RAM with a single host instruction.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "util/psxutil.hh"
+
+namespace Psx {
+namespace Fastmem {
+
+// Called for faults inside the view with the faulting host pc and the guest
+// address. Should point pc somewhere that handles the access and return
+// true, or return false if the fault isn't expected.
+using FaultHandler = bool (*)(uintptr_t& pc, u32 guest_addr);
+
+void Init();
+bool IsEnabled();
+u8* Base();
+void SetFaultHandler(FaultHandler handler);
+// map the BIOS from a file instead of the arena, -1 goes back to the arena
+void MapBios(int fd);
+
+// RAM pages are read-only in the view while they hold code, while the
+// cache is isolated, or until their first write since the dirty pages were
+// last taken, so those writes fault and take the slow path. The scratchpad
+// is read-only while the cache is isolated.
+void SetCacheIsolated(bool isolated);
+void ProtectCode(u32 ram_page);
+void UnprotectCode(u32 ram_page);
+void UnprotectAllCode();
+void TrackAllWrites();
+void UntrackWrites(u32 ram_page);
+void UntrackAllWrites();
+
+}// end namespace
+}
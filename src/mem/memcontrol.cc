@@ -8,6 +8,7 @@
  */
 
 #include "memcontrol.hh"
+#include "cpu/icache.hh"
 
 #include "imgui/imgui.h"
 
@@ -114,6 +115,7 @@ void Write(T data, u32 addr)
         s.regs.ram_size = static_cast<T>(data);
     } else if (is_cache_ctrl) {
         s.regs.cache_ctrl = static_cast<T>(data);
+        Cpu::ICache::SetControl(s.regs.cache_ctrl);
     } else {
         PSX_ASSERT(ctrl1_i < MCTRL_SIZE);
         s.regs.ctrl1[ctrl1_i] = static_cast<T>(data);
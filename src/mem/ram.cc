@@ -8,22 +8,28 @@
  */
 #include "ram.hh"
 
-#include <vector>
+#include <cstring>
 #include <memory>
 
 #include "imgui/imgui.h"
 
 #include "view/imgui/dbgmod.hh"
-#include "cpu/cop0.hh"
+#include "cpu/blockcache.hh"
+#include "mem/arena.hh"
+#include "mem/fastmem.hh"
 
 #define RAM_INFO(...) PSXLOG_INFO("RAM", __VA_ARGS__)
 #define RAM_WARN(...) PSXLOG_WARN("RAM", __VA_ARGS__)
 #define RAM_ERROR(...) PSXLOG_ERROR("RAM", __VA_ARGS__)
 
+constexpr u32 RamSize = Psx::Arena::RamSize; // 2MB
+
 // *** Private Functions and Data ***
 namespace  {
 struct State {
-    std::vector<u8> sysram;
+    // lives in the arena
+    u8 *sysram = nullptr;
+    Psx::Ram::DirtyPages dirty;
     Psx::View::ImGuiLayer::DbgMod::HexDump hexdump;
 } s;
 }// end namespace
@@ -36,15 +42,16 @@ namespace Ram {
 void Init()
 {
     RAM_INFO("Initializing 2MB of System RAM");
-    s.sysram.resize(2048 * 1024, 0); // 2MB
+    s.sysram = Arena::RamBase();
 }
 
 void Reset()
 {
     RAM_INFO("Resetting state");
-    for (auto& byte : s.sysram) {
-        byte = 0x00;
-    }
+    std::memset(s.sysram, 0, RamSize);
+    // everything changed, so there's no first write left to see
+    s.dirty.set();
+    Fastmem::UntrackAllWrites();
 
     s.hexdump = View::ImGuiLayer::DbgMod::HexDump();
 }
@@ -53,36 +60,9 @@ void Reset()
 template<class T>
 T Read(u32 addr)
 {
-#ifdef PSX_DEBUG
-    // not sure if this is needed
-    bool in_cache_region = (addr & 0x8000'0000) || ((addr & 0xf000'0000) == 0);
-    if (in_cache_region && Cop0::CacheIsIsolated()) {
-        RAM_WARN("Reading from RAM [0x{:08x}] while Cache is isolated. Did something break?", addr);
-    }
-#endif
-
     u32 maddr = addr & 0x1f'ffff; // addr % 2MB
-    T data = 0;
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.sysram.size());
-        // read8
-        data = s.sysram[maddr];
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.sysram.size() - 2);
-        // read16 as little endian
-        data  = s.sysram[maddr];
-        data |= static_cast<u16>(s.sysram[maddr + 1]) << 8;
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.sysram.size() - 4);
-        // read32 as little endian
-        data  = s.sysram[maddr];
-        data |= static_cast<u32>(s.sysram[maddr + 1]) << 8;
-        data |= static_cast<u32>(s.sysram[maddr + 2]) << 16;
-        data |= static_cast<u32>(s.sysram[maddr + 3]) << 24;
-    } else {
-        static_assert(!std::is_same_v<T, T>);
-    }
-    return data;
+    PSX_ASSERT(maddr <= RamSize - sizeof(T));
+    return Util::LoadLE<T>(s.sysram + maddr);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template u8 Read<u8>(u32 addr);
@@ -93,39 +73,54 @@ template u32 Read<u32>(u32 addr);
 template<class T>
 void Write(T data, u32 addr)
 {
-    // don't do any writes if cache is isolated (kuseg or kseg0)
-    bool in_cache_region = (addr & 0x8000'0000) || ((addr & 0xf000'0000) == 0);
-    if (in_cache_region && Cop0::CacheIsIsolated()) {
-        RAM_WARN("Cache is Isolated, skipping write [{}] to 0x{:08x}", data, addr);
-        return;
-    }
-
+    // cache isolation is handled by the bus, see Bus::SetCacheIsolated
     u32 maddr = addr & 0x1f'ffff; // addr % 2MB
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.sysram.size());
-        // write8
-        s.sysram[maddr] = data;
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.sysram.size() - 2);
-        // write16 as little endian
-        s.sysram[maddr + 0] = static_cast<u8>(data);
-        s.sysram[maddr + 1] = static_cast<u8>(data >> 8);
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.sysram.size() - 4);
-        // write32 as little endian
-        s.sysram[maddr + 0] = static_cast<u8>(data);
-        s.sysram[maddr + 1] = static_cast<u8>(data >> 8);
-        s.sysram[maddr + 2] = static_cast<u8>(data >> 16);
-        s.sysram[maddr + 3] = static_cast<u8>(data >> 24);
-    } else {
-        static_assert(!std::is_same_v<T, T>);
+    // drop any pre-decoded code in this page
+    Cpu::BlockCache::InvalidateRam(maddr);
+    u32 page = maddr / DirtyPageSize;
+    if (!s.dirty[page]) {
+        s.dirty[page] = true;
+        // no need to see the rest of the writes to this page
+        Fastmem::UntrackWrites(page);
     }
+    PSX_ASSERT(maddr <= RamSize - sizeof(T));
+    Util::StoreLE<T>(s.sysram + maddr, data);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template void Write<u8>(u8 data, u32 addr);
 template void Write<u16>(u16 data, u32 addr);
 template void Write<u32>(u32 data, u32 addr);
 
+/*
+ * Pointer to the start of the 2MB of system RAM on the host. Stays valid
+ * after Init.
+ */
+u8* HostPtr()
+{
+    return s.sysram;
+}
+
+/*
+ * Returns the pages written since the last call and starts tracking again.
+ */
+DirtyPages TakeDirtyPages()
+{
+    DirtyPages dirty = s.dirty;
+    s.dirty.reset();
+    // fastmem stores skip Ram::Write, so make them fault until the first
+    // write to each page
+    Fastmem::TrackAllWrites();
+    return dirty;
+}
+
+/*
+ * The pages written since the last TakeDirtyPages, without clearing them.
+ */
+const DirtyPages& PeekDirtyPages()
+{
+    return s.dirty;
+}
+
 /*
  * To be called on every ImGui update while the debug module is active.
  */
@@ -136,7 +131,7 @@ void OnActive(bool *active)
         return;
     }
 
-    s.hexdump.Update(s.sysram);
+    s.hexdump.Update({s.sysram, RamSize});
 
     ImGui::End();
 }
@@ -9,6 +9,8 @@
 
 #pragma once
 
+#include <bitset>
+
 #include "util/psxutil.hh"
 
 namespace Psx {
@@ -23,6 +25,16 @@ T Read(u32 addr);
 template<class T>
 void Write(T data, u32 addr);
 
+// backing memory, for direct accesses from the bus and recompiler
+u8* HostPtr();
+
+// writes are tracked per page, a set bit means the page was written since
+// the last TakeDirtyPages
+constexpr u32 DirtyPageSize = 4 * 1024;
+using DirtyPages = std::bitset<2 * 1024 * 1024 / DirtyPageSize>;
+DirtyPages TakeDirtyPages();
+const DirtyPages& PeekDirtyPages();
+
 void OnActive(bool *active);
 
 }// end namespace
@@ -10,11 +10,12 @@
 
 #include "scratchpad.hh"
 
-#include <vector>
+#include <cstring>
 
 #include "imgui/imgui.h"
 
 #include "view/imgui/dbgmod.hh"
+#include "mem/arena.hh"
 
 #define SP_INFO(...) PSXLOG_INFO("Scratchpad", __VA_ARGS__)
 #define SP_WARN(...) PSXLOG_WARN("Scratchpad", __VA_ARGS__)
@@ -23,7 +24,8 @@
 namespace  {
 
 struct State {
-    std::vector<u8> mem;
+    // lives in the arena
+    u8 *mem = nullptr;
     Psx::View::ImGuiLayer::DbgMod::HexDump hexdump;
 } s;
 
@@ -35,46 +37,31 @@ namespace Scratchpad {
 void Init()
 {
     SP_INFO("Intializing 1KB of Scratchpad");
-    s.mem.resize(1024);
+    s.mem = Arena::ScratchpadBase();
 }
 
 void Reset()
 {
     SP_INFO("Resetting state");
-    for (auto& byte : s.mem) {
-        byte = 0x00;
-    }
+    std::memset(s.mem, 0, Arena::ScratchpadSize);
+}
+
+/*
+ * Pointer to the start of the 1KB scratchpad on the host. Stays valid after
+ * Init.
+ */
+u8* HostPtr()
+{
+    return s.mem;
 }
 
 // *** Read ***
 template<class T>
 T Read(u32 addr)
 {
-    // let future travis deal with this :/
-    PSX_ASSERT(0);
-
     u32 maddr = addr & 0x3ff; // addr % 1KB
-    T data = 0;
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.mem.size());
-        // read8
-        data = s.mem[maddr];
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.mem.size() - 2);
-        // read16 as little endian
-        data  = s.mem[maddr];
-        data |= static_cast<u16>(s.mem[maddr + 1]) << 8;
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.mem.size() - 4);
-        // read32 as little endian
-        data  = s.mem[maddr];
-        data |= static_cast<u32>(s.mem[maddr + 1]) << 8;
-        data |= static_cast<u32>(s.mem[maddr + 2]) << 16;
-        data |= static_cast<u32>(s.mem[maddr + 3]) << 24;
-    } else {
-        static_assert(!std::is_same_v<T, T>);
-    }
-    return data;
+    PSX_ASSERT(maddr <= Arena::ScratchpadSize - sizeof(T));
+    return Util::LoadLE<T>(s.mem + maddr);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template u8 Read<u8>(u32 addr);
@@ -85,29 +72,9 @@ template u32 Read<u32>(u32 addr);
 template<class T>
 void Write(T data, u32 addr)
 {
-    // let future travis deal with this :/
-    PSX_ASSERT(0);
-    
     u32 maddr = addr & 0x3ff; // addr % 1KB
-    if constexpr (std::is_same_v<T, u8>) {
-        PSX_ASSERT(maddr < s.mem.size());
-        // write8
-        s.mem[maddr] = data;
-    } else if constexpr (std::is_same_v<T, u16>) {
-        PSX_ASSERT(maddr < s.mem.size() - 2);
-        // write16 as little endian
-        s.mem[maddr + 0] = static_cast<u8>(data);
-        s.mem[maddr + 1] = static_cast<u8>(data >> 8);
-    } else if constexpr (std::is_same_v<T, u32>) {
-        PSX_ASSERT(maddr < s.mem.size() - 4);
-        // write32 as little endian
-        s.mem[maddr + 0] = static_cast<u8>(data);
-        s.mem[maddr + 1] = static_cast<u8>(data >> 8);
-        s.mem[maddr + 2] = static_cast<u8>(data >> 16);
-        s.mem[maddr + 3] = static_cast<u8>(data >> 24);
-    } else {
-        static_assert(!std::is_same_v<T, T>);
-    }
+    PSX_ASSERT(maddr <= Arena::ScratchpadSize - sizeof(T));
+    Util::StoreLE<T>(s.mem + maddr, data);
 }
 // template impl needs to be visable to other cpp files to avoid compile err
 template void Write<u8>(u8 data, u32 addr);
@@ -124,7 +91,7 @@ void OnActive(bool *active)
         return;
     }
 
-    s.hexdump.Update(s.mem);
+    s.hexdump.Update({s.mem, Arena::ScratchpadSize});
 
     ImGui::End();
 }
@@ -21,6 +21,9 @@ void Reset();
 template<class T> T Read(u32 addr);
 template<class T> void Write(T data, u32 addr);
 
+// backing memory, for direct accesses from the bus
+u8* HostPtr();
+
 void OnActive(bool *active);
 
 }// end namespace
@@ -10,6 +10,7 @@
 #include "psxutil.hh"
 
 #include <chrono>
+#include <thread>
 
 namespace Psx {
 namespace Util {
@@ -27,14 +28,20 @@ bool OneSecPassed()
     return false;
 }
 
-long long GetDeltaTime()
+/*
+ * Block until the deadline. Sleeps through most of the wait and spins the
+ * rest, a sleep alone can overshoot by a whole scheduler tick.
+ */
+void SleepUntil(std::chrono::steady_clock::time_point deadline)
 {
     using namespace std::chrono;
-    static auto last = std::chrono::high_resolution_clock::now();
-    auto now = std::chrono::high_resolution_clock::now();
-    auto ns = duration_cast<nanoseconds>(now - last);
-    last = now;
-    return ns.count();
+    constexpr auto SpinTime = milliseconds(2);
+    if (deadline - steady_clock::now() > SpinTime) {
+        std::this_thread::sleep_until(deadline - SpinTime);
+    }
+    while (steady_clock::now() < deadline) {
+        std::this_thread::yield();
+    }
 }
 
 }// end ns
@@ -9,8 +9,11 @@
 
 #pragma once
 
+#include <bit>
+#include <chrono>
 #include <cstdint>
 #include <cassert>
+#include <cstring>
 #include <string>
 #include <iostream>
 
@@ -70,12 +73,52 @@ inline u32 GetBits(u32 word, uint index, uint size)
     return (word >> index) & ~(0xffff'ffff << size);
 }
 
+/*
+ * Reverse the byte order of an integer.
+ */
+template<class T>
+inline T ByteSwap(T val)
+{
+    T swapped = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        swapped = static_cast<T>((swapped << 8) | ((val >> (8 * i)) & 0xff));
+    }
+    return swapped;
+}
+
+/*
+ * Load a little endian value from host memory. The pointer doesn't need to
+ * be aligned. On little endian hosts this is a single host load.
+ */
+template<class T>
+inline T LoadLE(const u8 *src)
+{
+    T data;
+    std::memcpy(&data, src, sizeof(T));
+    if constexpr (std::endian::native == std::endian::big) {
+        data = ByteSwap(data);
+    }
+    return data;
+}
+
+/*
+ * Store a value to host memory as little endian, see LoadLE.
+ */
+template<class T>
+inline void StoreLE(u8 *dst, T data)
+{
+    if constexpr (std::endian::native == std::endian::big) {
+        data = ByteSwap(data);
+    }
+    std::memcpy(dst, &data, sizeof(T));
+}
+
 /*
  * Return true if one sec has passed since the last call
  */
 bool OneSecPassed();
 
-long long GetDeltaTime();
+void SleepUntil(std::chrono::steady_clock::time_point deadline);
 
 }// end ns
 }
@@ -26,7 +26,7 @@ namespace {
  * Creates one line of hexdump output for a given address. Will proccess 16 bytes
  * of data starting at the given address.
  */
-std::string hexDumpLine(u32 addr, const std::vector<u8>& mem)
+std::string hexDumpLine(u32 addr, std::span<const u8> mem)
 {
     /* PSX_ASSERT((size_t)addr + 16 <= mem.size()); */
     if ((size_t)addr + 16 > mem.size()) {
@@ -75,7 +75,7 @@ HexDump::HexDump()
     m_file_name.resize(64);
 }
 
-void HexDump::Update(const std::vector<u8>& mem)
+void HexDump::Update(std::span<const u8> mem)
 {
     u32 last_line = (u32)mem.size() >> 4;
 
@@ -160,7 +160,7 @@ void HexDump::Update(const std::vector<u8>& mem)
 
 }
 
-void HexDump::dumpToFile(const std::vector<u8>& mem)
+void HexDump::dumpToFile(std::span<const u8> mem)
 {
     DBG_INFO("Dump Mem to {}", m_file_name);
     // open file
@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <span>
 #include <vector>
 
 #include "util/psxutil.hh"
@@ -21,9 +22,9 @@ namespace DbgMod {
 class HexDump {
 public:
     HexDump();
-    void Update(const std::vector<u8>& mem);
+    void Update(std::span<const u8> mem);
 private:
-    void dumpToFile(const std::vector<u8>& mem);
+    void dumpToFile(std::span<const u8> mem);
     u32 m_start_line = 0;
     bool m_find_target = false;
     u32 m_target = 0;
@@ -130,6 +130,16 @@ void OnUpdate()
                 IMGUILAYER_INFO("Resetting Emulator");
                 System::Reset();
             }
+            ImGui::MenuItem("Turbo", NULL, &g_emu_state.turbo);
+            if (ImGui::BeginMenu("Speed")) {
+                for (float speed : {0.25f, 0.5f, 1.0f, 2.0f, 4.0f}) {
+                    if (ImGui::MenuItem(PSX_FMT("{}x", speed).c_str(), NULL, g_emu_state.speed == speed)) {
+                        IMGUILAYER_INFO("Running at {}x speed", speed);
+                        g_emu_state.speed = speed;
+                    }
+                }
+                ImGui::EndMenu();
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
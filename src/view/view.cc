@@ -26,6 +26,7 @@ namespace {
 struct State {
     Psx::Vulkan::Window *window = nullptr;
     const std::string title_base = "PSX Emulator";
+    bool draw_enabled = true;
 }s;
 
 } // end private ns
@@ -68,9 +69,21 @@ void OnUpdate()
 
 void DrawPolygon(const Geometry::Polygon& polygon)
 {
+    if (!s.draw_enabled) {
+        return;
+    }
     s.window->DrawPolygon(polygon);
 }
 
+/*
+ * While disabled, polygons from the gpu are dropped instead of rasterized.
+ * Used for frames that are skipped and never shown.
+ */
+void SetDrawEnabled(bool enabled)
+{
+    s.draw_enabled = enabled;
+}
+
 void Clear()
 {
     s.window->Clear();
@@ -20,6 +20,7 @@
 #include "psxtest_mem.hh"
 #include "psxtest_asm.hh"
 #include "psxtest_cpu.hh"
+#include "psxtest_sys.hh"
 
 #define TMAIN_INFO(msg) PSXLOG_INFO("Test-Main", msg)
 #define TMAIN_WARN(msg) PSXLOG_WARN("Test-Main", msg)
@@ -43,5 +44,9 @@ int main()
     TMAIN_INFO("Starting CPU Tests");
     Psx::Test::CpuTests();
 
+    // call system tests
+    TMAIN_INFO("Starting System Tests");
+    Psx::Test::SysTests(psx);
+
     return 0;
 }
@@ -7,15 +7,25 @@
  * Tests for the CPU on the PSX.
  */
 
+#include <filesystem>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "util/psxutil.hh"
 #include "util/psxlog.hh"
 #include "cpu/cpu.hh"
 #include "core/sys.hh"
+#include "core/scheduler.hh"
 #include "mem/bus.hh"
 #include "mem/ram.hh"
+#include "cpu/blockcache.hh"
+#include "cpu/cop0.hh"
+#include "cpu/icache.hh"
+#include "cpu/interrupt.hh"
+#include "cpu/jit/jit.hh"
+#include "cpu/transcache.hh"
 
 #define TCPU_INFO(...) PSXLOG_INFO("Test-CPU", __VA_ARGS__)
 #define TCPU_WARN(...) PSXLOG_WARN("Test-CPU", __VA_ARGS__)
@@ -1294,21 +1304,804 @@ static void branchTests()
     assert(Cpu::GetR(31) == 0x1008 + 4);
 }
 
+static void blockCacheTests()
+{
+    TCPU_INFO("** Starting Block Cache Tests -------------------------");
+    // setup hardware
+    System::Reset();
+
+    //========================
+    // loop
+    //========================
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R1 1"), 0x2000);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("BNE R1 R2 -2"), 0x2004);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R3 R3 1"), 0x2008);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R4 R0 7"), 0x200c);
+    Cpu::SetR(2, 5);
+    Cpu::SetPC(0x2000);
+    for (int i = 0; i < 5 * 3 + 1; i++) {
+        Cpu::Step();
+    }
+    assert(Cpu::GetPC() == 0x2010);
+    assert(Cpu::GetR(1) == 5);
+    assert(Cpu::GetR(3) == 5);
+    assert(Cpu::GetR(4) == 7);
+    assert(Cpu::BlockCache::NumBlocks() == 2);
+
+    //========================
+    // delay slot analysis
+    //========================
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R7 R0 1"), 0x2400);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("LW R1 0 R0"), 0x2404);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R2 R0 1"), 0x2408);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("LW R3 0 R0"), 0x240c);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R4 R3 1"), 0x2410);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x2400"), 0x2414);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R6 R0 1"), 0x2418);
+    Cpu::SetPC(0x2400);
+    Cpu::Step();
+    {
+        const auto& instrs = Cpu::BlockCache::Lookup(0x2400)->instrs;
+        assert(instrs.size() == 7);
+        // anything can be pending at the start of a block
+        assert(!instrs[0].no_delay);
+        assert(instrs[1].no_delay && instrs[1].commit_load);
+        assert(instrs[2].no_delay);
+        // loaded register is used right away
+        assert(instrs[3].no_delay && !instrs[3].commit_load);
+        assert(!instrs[4].no_delay);
+        assert(instrs[5].no_delay);
+        // branch delay slot
+        assert(!instrs[6].no_delay);
+    }
+
+    //========================
+    // self-modifying code
+    //========================
+    u64 invalidations = Cpu::BlockCache::NumInvalidations();
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R4 R0 9"), 0x200c);
+    assert(Cpu::BlockCache::NumInvalidations() == invalidations + 1);
+    assert(Cpu::BlockCache::NumBlocks() == 0);
+    Cpu::SetPC(0x200c);
+    Cpu::Step();
+    assert(Cpu::GetR(4) == 9);
+
+    // a block spanning two pages is dropped from both, so a later write to
+    // the second page leaves a block rebuilt in the first alone
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R0 1"), 0x9ff8);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R2 R0 2"), 0x9ffc);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x9ff8"), 0xa000);
+    Bus::Write<u32>(0, 0xa004);
+    Cpu::SetPC(0x9ff8);
+    Cpu::Step();
+    assert(Cpu::BlockCache::Lookup(0x9ff8)->instrs.size() == 4);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x9ff8"), 0x9ff8);
+    Bus::Write<u32>(0, 0x9ffc);
+    Cpu::SetPC(0x9ff8);
+    Cpu::Step();
+    assert(Cpu::BlockCache::Lookup(0x9ff8)->instrs.size() == 2);
+    invalidations = Cpu::BlockCache::NumInvalidations();
+    Bus::Write<u32>(0, 0xa100);
+    assert(Cpu::BlockCache::NumInvalidations() == invalidations);
+    assert(Cpu::BlockCache::Lookup(0x9ff8) != nullptr);
+
+    // store into the block that is currently running
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("SW R5 0 R6"), 0x3000);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R7 R0 1"), 0x3004);
+    Cpu::SetR(5, Cpu::Asm::AsmInstruction("ADDI R7 R0 2"));
+    Cpu::SetR(6, 0x3004);
+    Cpu::SetPC(0x3000);
+    Cpu::Step();
+    Cpu::Step();
+    assert(Cpu::GetR(7) == 2);
+}
+
+static void icacheTests()
+{
+    TCPU_INFO("** Starting Instruction Cache Tests -------------------");
+    // setup hardware
+    System::Reset();
+    Cpu::SetExecMode(Cpu::ExecMode::Interpreter);
+    Bus::Write<u32>(0x800, 0xfffe'0130);
+    assert(Cpu::ICache::IsEnabled());
+
+    // the first fetch misses and fills the line
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R0 1"), 0x2000);
+    Cpu::SetPC(0x8000'2000);
+    Cpu::Step();
+    assert(Cpu::GetR(1) == 1);
+    assert(Cpu::ICache::NumMisses() == 1 && Cpu::ICache::NumHits() == 0);
+
+    // code changed behind the cache's back is only seen uncached
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R0 2"), 0x2000);
+    Cpu::SetPC(0x8000'2000);
+    Cpu::Step();
+    assert(Cpu::GetR(1) == 1);
+    assert(Cpu::ICache::NumHits() == 1);
+    Cpu::SetPC(0xa000'2000);
+    Cpu::Step();
+    assert(Cpu::GetR(1) == 2);
+    assert(Cpu::ICache::NumHits() == 1 && Cpu::ICache::NumMisses() == 1);
+
+    // flush the line the way the BIOS does
+    Bus::Write<u32>(0x804, 0xfffe'0130);
+    Cop0::Mt(1u << 16, 12);
+    Bus::Write<u32>(0, 0x0000'0000);
+    Cop0::Mt(0, 12);
+    Bus::Write<u32>(0x800, 0xfffe'0130);
+    Cpu::SetPC(0x8000'2000);
+    Cpu::Step();
+    assert(Cpu::GetR(1) == 2);
+    assert(Cpu::ICache::NumMisses() == 2);
+
+    // flushes drop the blocks decoded from the line
+    Cpu::SetExecMode(Cpu::ExecMode::CachedInterpreter);
+    Cpu::SetPC(0x8000'2000);
+    Cpu::Step();
+    assert(Cpu::BlockCache::Lookup(0x8000'2000) != nullptr);
+    u64 invalidations = Cpu::BlockCache::NumInvalidations();
+    Bus::Write<u32>(0x804, 0xfffe'0130);
+    Cop0::Mt(1u << 16, 12);
+    Bus::Write<u32>(0, 0x0000'0000);
+    Cop0::Mt(0, 12);
+    assert(Cpu::BlockCache::NumInvalidations() == invalidations + 1);
+    assert(Cpu::BlockCache::Lookup(0x8000'2000) == nullptr);
+    Cpu::SetExecMode(Cpu::ExecMode::Interpreter);
+}
+
+static void runTests()
+{
+    TCPU_INFO("** Starting Batch Run Tests ---------------------------");
+    // setup hardware
+    System::Reset();
+
+    //========================
+    // budget
+    //========================
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R1 1"), 0x5000);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x5000"), 0x5004);
+    Bus::Write<u32>(0, 0x5008);
+    Cpu::SetPC(0x5000);
+    assert(Cpu::Run(300) == 300);
+    assert(Cpu::GetR(1) == 100);
+    assert(Cpu::GetPC() == 0x5000);
+
+    //========================
+    // early exit
+    //========================
+    // unmasking a pending interrupt schedules its check inside the slice,
+    // which ends the batch
+    Cop0::Mt(0x401, 12); // IEc and IM2
+    Interrupt::Signal(Interrupt::Type::Timer2);
+    // fire the video events due at reset first
+    Scheduler::Advance(0);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("LUI R2 0x1f80"), 0x6000);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R4 R0 0x40"), 0x6004);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("SW R4 0x1074 R2"), 0x6008);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R3 R0 1"), 0x600c);
+    Cpu::SetPC(0x6000);
+    assert(Cpu::Run(Scheduler::NextSlice(100)) == 3);
+    assert(Cpu::GetPC() == 0x600c);
+    assert(Cpu::GetR(3) == 0);
+
+    //========================
+    // interrupts
+    //========================
+    // taken once, the handler runs with interrupts off until it returns
+    Scheduler::Advance(3);
+    assert(Cpu::GetPC() == 0x8000'0080);
+    assert((Cop0::Mf(13) & 0x400) != 0);
+    assert((Cop0::Mf(12) & 0x3f) == 0x04);
+    Scheduler::Advance(1000);
+    assert((Cop0::Mf(12) & 0x3f) == 0x04);
+    // still not acknowledged, so it's taken again right after rfe
+    Cpu::SetPC(0x6000);
+    Cop0::ExeCmd(0x10);
+    assert((Cop0::Mf(12) & 0x3f) == 0x01);
+    Scheduler::Advance(0);
+    assert(Cpu::GetPC() == 0x8000'0080);
+    // masking it in SR holds it off
+    Cop0::ExeCmd(0x10);
+    Cop0::Mt(0x001, 12);
+    Cpu::SetPC(0x6000);
+    Scheduler::Advance(0);
+    assert(Cpu::GetPC() == 0x6000);
+    // acknowledging drops the line
+    Bus::Write<u32>(0, 0x1f80'1070);
+    assert((Cop0::Mf(13) & 0x400) == 0);
+}
+
+static void idleLoopTests()
+{
+    TCPU_INFO("** Starting Idle Loop Tests ---------------------------");
+    for (Cpu::ExecMode mode : {Cpu::ExecMode::Interpreter, Cpu::ExecMode::CachedInterpreter,
+                               Cpu::ExecMode::Recompiler}) {
+        // setup hardware
+        System::Reset();
+        Cpu::SetExecMode(mode);
+        bool detects = mode != Cpu::ExecMode::Interpreter && Cpu::GetExecMode() == mode;
+
+        // poll a word of ram until it becomes non-zero
+        Bus::Write<u32>(0, 0x100);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("LW R1 0x100 R0"), 0x7000);
+        Bus::Write<u32>(0, 0x7004);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("BEQ R1 R0 -3"), 0x7008);
+        Bus::Write<u32>(0, 0x700c);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R3 R0 1"), 0x7010);
+        Cpu::SetPC(0x7000);
+
+        // one iteration to see that nothing changed, the rest gets skipped
+        u64 skipped = Cpu::IdleCyclesSkipped();
+        assert(Cpu::Run(1000) == 1000);
+        assert(Cpu::GetPC() == 0x7000);
+        assert(Cpu::IdleCyclesSkipped() - skipped == (detects ? 1000 - 4 : 0));
+
+        // the loop must still notice the write once the batch is over
+        Bus::Write<u32>(1, 0x100);
+        skipped = Cpu::IdleCyclesSkipped();
+        Cpu::Run(100);
+        assert(Cpu::GetR(1) == 1);
+        assert(Cpu::GetR(3) == 1);
+        assert(Cpu::IdleCyclesSkipped() == skipped);
+
+        // timer 2 at 1/8 of the system clock reads the same value a few times
+        // in a row, but it still counts without any event
+        Bus::Write<u32>(0x200, 0x1f80'1124);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("LW R1 0x1120 R2"), 0x7000);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("BEQ R0 R0 -2"), 0x7004);
+        Bus::Write<u32>(0, 0x7008);
+        Cpu::SetR(2, 0x1f80'0000);
+        Cpu::SetPC(0x7000);
+        skipped = Cpu::IdleCyclesSkipped();
+        assert(Cpu::Run(1000) >= 1000);
+        assert(Cpu::IdleCyclesSkipped() == skipped);
+    }
+}
+
+// raw encoders, so the random programs don't depend on the assembler
+static u32 encodeR(u32 funct, u32 rs, u32 rt, u32 rd, u32 shamt = 0)
+{
+    return (rs << 21) | (rt << 16) | (rd << 11) | (shamt << 6) | funct;
+}
+
+static u32 encodeI(u32 op, u32 rs, u32 rt, u32 imm)
+{
+    return (op << 26) | (rs << 21) | (rt << 16) | (imm & 0xffff);
+}
+
+static u32 xorshift(u32& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+constexpr u32 ProgBase = 0x4000;
+constexpr u32 DataBase = 0x8000;
+constexpr u32 DataWords = 64;
+
+struct CpuSnapshot {
+    u32 pc = 0;
+    u32 hi = 0;
+    u32 lo = 0;
+    u32 epc = 0;
+    u32 r[32] = {0};
+    u32 data[DataWords] = {0};
+    bool operator==(const CpuSnapshot&) const = default;
+};
+
+/*
+ * Run the program from a clean system until the pc hits stop_pc, then grab
+ * the cpu state. R9 always points at the data area. When batched, the program
+ * runs through Cpu::Run() instead of Cpu::Step().
+ */
+static CpuSnapshot runProgram(Cpu::ExecMode mode, const std::vector<u32>& code,
+    const std::vector<u32>& regs, const std::vector<u32>& data, u32 stop_pc, bool batched = false)
+{
+    System::Reset();
+    Cpu::SetExecMode(mode);
+    for (u32 i = 0; i < code.size(); i++) {
+        Bus::Write<u32>(code[i], ProgBase + 4 * i);
+    }
+    for (u32 i = 0; i < data.size(); i++) {
+        Bus::Write<u32>(data[i], DataBase + 4 * i);
+    }
+    for (u32 i = 1; i < regs.size(); i++) {
+        Cpu::SetR(i, regs[i]);
+    }
+    Cpu::SetR(9, DataBase);
+    Cpu::SetPC(ProgBase);
+
+    u32 steps = 0;
+    while (Cpu::GetPC() != stop_pc) {
+        steps += batched ? Cpu::Run(1) : Cpu::Step();
+        assert(steps < 100'000);
+    }
+
+    CpuSnapshot snap;
+    snap.pc = Cpu::GetPC();
+    snap.hi = Cpu::GetHI();
+    snap.lo = Cpu::GetLO();
+    snap.epc = Cop0::Mf(14);
+    for (u32 i = 0; i < 32; i++) {
+        snap.r[i] = Cpu::GetR(i);
+    }
+    for (u32 i = 0; i < DataWords; i++) {
+        snap.data[i] = Bus::Read<u32>(DataBase + 4 * i);
+    }
+    return snap;
+}
+
+/*
+ * Random non-trapping instruction, writes to R0-R8 and reads from R0-R9.
+ */
+static u32 randomOp(u32& rng)
+{
+    u32 rd = xorshift(rng) % 9;
+    u32 rs = xorshift(rng) % 10;
+    u32 rt = xorshift(rng) % 10;
+    u32 imm = xorshift(rng) & 0xffff;
+    u32 off = xorshift(rng) % (DataWords * 4);
+    switch (xorshift(rng) % 36) {
+    // alu immediate
+    case 0: return encodeI(0x09, rs, rd, imm); // ADDIU
+    case 1: return encodeI(0x0b, rs, rd, imm); // SLTIU
+    case 2: return encodeI(0x0c, rs, rd, imm); // ANDI
+    case 3: return encodeI(0x0d, rs, rd, imm); // ORI
+    case 4: return encodeI(0x0e, rs, rd, imm); // XORI
+    case 5: return encodeI(0x0f, 0, rd, imm);  // LUI
+    // alu register
+    case 6: return encodeR(0x21, rs, rt, rd); // ADDU
+    case 7: return encodeR(0x23, rs, rt, rd); // SUBU
+    case 8: return encodeR(0x2b, rs, rt, rd); // SLTU
+    case 9: return encodeR(0x24, rs, rt, rd); // AND
+    case 10: return encodeR(0x25, rs, rt, rd); // OR
+    case 11: return encodeR(0x26, rs, rt, rd); // XOR
+    case 12: return encodeR(0x27, rs, rt, rd); // NOR
+    // shifts
+    case 13: return encodeR(0x00, 0, rt, rd, imm & 0x1f); // SLL
+    case 14: return encodeR(0x02, 0, rt, rd, imm & 0x1f); // SRL
+    case 15: return encodeR(0x03, 0, rt, rd, imm & 0x1f); // SRA
+    case 16: return encodeR(0x04, rs, rt, rd); // SLLV
+    case 17: return encodeR(0x06, rs, rt, rd); // SRLV
+    case 18: return encodeR(0x07, rs, rt, rd); // SRAV
+    // mult/div
+    case 19: return encodeR(0x18, rs, rt, 0); // MULT
+    case 20: return encodeR(0x19, rs, rt, 0); // MULTU
+    case 21: return encodeR(0x1a, rs, rt, 0); // DIV
+    case 22: return encodeR(0x1b, rs, rt, 0); // DIVU
+    case 23: return encodeR(0x10, 0, 0, rd); // MFHI
+    case 24: return encodeR(0x12, 0, 0, rd); // MFLO
+    case 25: return encodeR(xorshift(rng) & 1 ? 0x11 : 0x13, 0, 0, rs); // MTHI/MTLO
+    // loads
+    case 26: return encodeI(0x20, 9, rd, off); // LB
+    case 27: return encodeI(0x24, 9, rd, off); // LBU
+    case 28: return encodeI(0x21, 9, rd, off & ~1u); // LH
+    case 29: return encodeI(0x25, 9, rd, off & ~1u); // LHU
+    case 30: return encodeI(0x23, 9, rd, off & ~3u); // LW
+    case 31: return encodeI(xorshift(rng) & 1 ? 0x22 : 0x26, 9, rd, off); // LWL/LWR
+    // stores
+    case 32: return encodeI(0x28, 9, rt, off); // SB
+    case 33: return encodeI(0x29, 9, rt, off & ~1u); // SH
+    default: return encodeI(0x2b, 9, rt, off & ~3u); // SW
+    }
+}
+
+/*
+ * Forward branch from instruction i to somewhere in [i + 2, len].
+ */
+static u32 randomBranch(u32& rng, u32 i, u32 len)
+{
+    u32 rs = xorshift(rng) % 10;
+    u32 rt = xorshift(rng) % 10;
+    u32 offset = 1 + xorshift(rng) % (len - i - 1);
+    switch (xorshift(rng) % 8) {
+    case 0: return encodeI(0x04, rs, rt, offset); // BEQ
+    case 1: return encodeI(0x05, rs, rt, offset); // BNE
+    case 2: return encodeI(0x06, rs, 0, offset); // BLEZ
+    case 3: return encodeI(0x07, rs, 0, offset); // BGTZ
+    case 4: return encodeI(0x01, rs, 0x00, offset); // BLTZ
+    case 5: return encodeI(0x01, rs, 0x01, offset); // BGEZ
+    case 6: return encodeI(0x01, rs, 0x10, offset); // BLTZAL
+    default: return encodeI(0x01, rs, 0x11, offset); // BGEZAL
+    }
+}
+
+static void recompilerTests()
+{
+    TCPU_INFO("** Starting Recompiler Tests --------------------------");
+    Cpu::SetExecMode(Cpu::ExecMode::Recompiler);
+    if (Cpu::GetExecMode() != Cpu::ExecMode::Recompiler) {
+        TCPU_WARN("Recompiler not supported on this host, skipping");
+        return;
+    }
+
+    //========================
+    // random programs, the recompiler must match the interpreter
+    //========================
+    constexpr u32 ProgLen = 48;
+    u32 rng = 0x1234'5678;
+    for (int prog = 0; prog < 200; prog++) {
+        std::vector<u32> code;
+        for (u32 i = 0; i < ProgLen; i++) {
+            bool delay_slot = i > 0 && (code[i - 1] >> 26) >= 0x01 && (code[i - 1] >> 26) <= 0x07;
+            if (!delay_slot && i < ProgLen - 2 && xorshift(rng) % 8 == 0) {
+                code.push_back(randomBranch(rng, i, ProgLen));
+            } else {
+                code.push_back(randomOp(rng));
+            }
+        }
+        if (prog % 2 == 1) {
+            // rebuild R9 so the optimizer sees constant addresses
+            code[0] = encodeI(0x0f, 0, 9, 0); // LUI
+            code[1] = encodeI(0x0d, 9, 9, DataBase); // ORI
+        }
+        // jump to the end
+        u32 end = ProgBase + 4 * (ProgLen + 2);
+        code.push_back((0x02u << 26) | (end >> 2));
+        code.push_back(0);
+
+        std::vector<u32> regs, data;
+        for (u32 i = 0; i < 32; i++) {
+            regs.push_back(xorshift(rng));
+        }
+        for (u32 i = 0; i < DataWords; i++) {
+            data.push_back(xorshift(rng));
+        }
+
+        CpuSnapshot interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, data, end);
+        CpuSnapshot jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, data, end);
+        assert(interp == jit);
+        Cpu::Jit::SetOptimize(false);
+        CpuSnapshot unoptimized = runProgram(Cpu::ExecMode::Recompiler, code, regs, data, end);
+        Cpu::Jit::SetOptimize(true);
+        assert(interp == unoptimized);
+        Cpu::Jit::SetFastmem(false);
+        CpuSnapshot slowmem = runProgram(Cpu::ExecMode::Recompiler, code, regs, data, end);
+        Cpu::Jit::SetFastmem(true);
+        assert(interp == slowmem);
+        // the cached interpreter's fast paths too
+        CpuSnapshot cached = runProgram(Cpu::ExecMode::CachedInterpreter, code, regs, data, end, true);
+        assert(interp == cached);
+    }
+
+    //========================
+    // exceptions in the middle of a block
+    //========================
+    std::vector<u32> code = {
+        Cpu::Asm::AsmInstruction("ADDI R1 R0 1"),
+        Cpu::Asm::AsmInstruction("LUI R2 0x7fff"),
+        Cpu::Asm::AsmInstruction("ORI R2 R2 0xffff"),
+        Cpu::Asm::AsmInstruction("ADD R3 R2 R1"), // overflow
+        Cpu::Asm::AsmInstruction("ADDI R4 R0 1"),
+    };
+    CpuSnapshot interp = runProgram(Cpu::ExecMode::Interpreter, code, {}, {}, 0x8000'0080);
+    CpuSnapshot jit = runProgram(Cpu::ExecMode::Recompiler, code, {}, {}, 0x8000'0080);
+    assert(interp == jit);
+    assert(jit.r[1] == 1 && jit.r[3] == 0 && jit.r[4] == 0);
+
+    // unaligned load
+    code = {
+        Cpu::Asm::AsmInstruction("ADDI R1 R0 1"),
+        Cpu::Asm::AsmInstruction("LW R2 2 R9"),
+        Cpu::Asm::AsmInstruction("ADDI R4 R0 1"),
+    };
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, {}, {}, 0x8000'0080);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, {}, {}, 0x8000'0080);
+    assert(interp == jit);
+    assert(jit.r[1] == 1 && jit.r[4] == 0);
+
+    //========================
+    // store into the block that is currently running
+    //========================
+    code = {
+        Cpu::Asm::AsmInstruction("SW R5 4 R6"),
+        Cpu::Asm::AsmInstruction("ADDI R7 R0 1"),
+        Cpu::Asm::AsmInstruction("J 0x4010"),
+        0,
+    };
+    std::vector<u32> regs(8, 0);
+    regs[5] = Cpu::Asm::AsmInstruction("ADDI R7 R0 2");
+    regs[6] = ProgBase;
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x4010);
+    assert(jit.r[7] == 2);
+    // code pages are write protected in the fastmem view
+    assert(!Cpu::Jit::GetFastmem() || Cpu::Jit::NumFastmemFaults() > 0);
+
+    // same thing through a constant address
+    code = {
+        Cpu::Asm::AsmInstruction("LUI R6 0"),
+        Cpu::Asm::AsmInstruction("ORI R6 R6 0x4000"),
+        Cpu::Asm::AsmInstruction("SW R5 0x10 R6"),
+        Cpu::Asm::AsmInstruction("ADDI R7 R0 1"),
+        Cpu::Asm::AsmInstruction("ADDI R7 R0 3"),
+        Cpu::Asm::AsmInstruction("J 0x401c"),
+        0,
+    };
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x401c);
+    assert(jit.r[7] == 2);
+
+    //========================
+    // optimizer
+    //========================
+    // known operands drop the overflow check, but must still trap when they
+    // do overflow
+    code = {
+        Cpu::Asm::AsmInstruction("LUI R1 0x7fff"),
+        Cpu::Asm::AsmInstruction("ORI R1 R1 0xfff0"),
+        Cpu::Asm::AsmInstruction("ADDI R2 R1 0xf"),
+        Cpu::Asm::AsmInstruction("ADDI R3 R1 0x10"), // overflow
+        Cpu::Asm::AsmInstruction("ADDI R4 R0 1"),
+    };
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, {}, {}, 0x8000'0080);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, {}, {}, 0x8000'0080);
+    assert(interp == jit);
+    assert(jit.r[2] == 0x7fff'ffff && jit.r[3] == 0 && jit.r[4] == 0);
+    // stats get cleared on reset, so these only count the last program
+    assert(Cpu::Jit::GetOptStats().no_overflow > 0);
+
+    // overwritten writes are dropped, constant loads read RAM directly
+    code = {
+        Cpu::Asm::AsmInstruction("ADDU R1 R2 R3"),
+        Cpu::Asm::AsmInstruction("ADDIU R1 R0 5"),
+        Cpu::Asm::AsmInstruction("LUI R6 0"),
+        Cpu::Asm::AsmInstruction("ORI R6 R6 0x8000"),
+        Cpu::Asm::AsmInstruction("LW R2 4 R6"),
+        Cpu::Asm::AsmInstruction("ADDU R3 R2 R1"),
+        Cpu::Asm::AsmInstruction("ADDU R3 R3 R2"),
+        Cpu::Asm::AsmInstruction("J 0x4024"),
+        0,
+    };
+    regs = {0, 0, 1, 2};
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, {10, 20}, 0x4024);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {10, 20}, 0x4024);
+    assert(interp == jit);
+    assert(jit.r[1] == 5 && jit.r[2] == 20 && jit.r[3] == 26);
+    Cpu::Jit::OptStats stats = Cpu::Jit::GetOptStats();
+    assert(stats.dead_writes > 0 && stats.direct_mem > 0 && stats.const_folds > 0);
+
+    //========================
+    // fastmem
+    //========================
+    // io loads fault once, then get patched to the slow path
+    code = {
+        Cpu::Asm::AsmInstruction("J 0x4008"),
+        Cpu::Asm::AsmInstruction("ADDI R1 R0 3"),
+        Cpu::Asm::AsmInstruction("LW R2 0 R6"),
+        Cpu::Asm::AsmInstruction("ADDI R1 R1 -1"),
+        encodeI(0x05, 1, 0, 0xfffd), // BNE R1 R0 back to the LW
+        0,
+        Cpu::Asm::AsmInstruction("J 0x4020"),
+        0,
+    };
+    regs = std::vector<u32>(8, 0);
+    regs[6] = 0x1f80'1074; // I_MASK
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, {}, 0x4020);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x4020);
+    assert(interp == jit);
+    if (Cpu::Jit::GetFastmem()) {
+        assert(Cpu::Jit::NumFastmemFaults() == 1 && Cpu::Jit::NumFastmemPatches() == 1);
+    }
+
+    // stores are dropped while the cache is isolated
+    code = {
+        Cpu::Asm::AsmInstruction("LUI R1 1"),
+        Cpu::Asm::AsmInstruction("Cop0 MT R1 R12"),
+        Cpu::Asm::AsmInstruction("SW R5 0 R9"),
+        Cpu::Asm::AsmInstruction("Cop0 MT R0 R12"),
+        Cpu::Asm::AsmInstruction("LW R2 0 R9"),
+        Cpu::Asm::AsmInstruction("J 0x401c"),
+        0,
+    };
+    regs[5] = 0xdead'beef;
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, {10}, 0x401c);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {10}, 0x401c);
+    assert(interp == jit);
+    assert(jit.r[2] == 10 && jit.data[0] == 10);
+
+    // the scratchpad is mapped like RAM, its kseg1 mirror is a bus error
+    code = {
+        Cpu::Asm::AsmInstruction("SW R5 0 R6"),
+        Cpu::Asm::AsmInstruction("LW R2 0 R6"),
+        Cpu::Asm::AsmInstruction("ADDI R1 R0 1"),
+        Cpu::Asm::AsmInstruction("LW R3 0 R7"),
+        Cpu::Asm::AsmInstruction("ADDI R4 R0 1"),
+    };
+    regs[6] = 0x1f80'0100;
+    regs[7] = 0xbf80'0100;
+    interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, {}, 0x8000'0080);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x8000'0080);
+    assert(interp == jit);
+    assert(jit.r[2] == 0xdead'beef && jit.r[1] == 1 && jit.r[3] == 0 && jit.r[4] == 0);
+    assert((Cop0::Mf(13) >> 2 & 0x1f) == 0x07);
+    Cpu::Jit::SetFastmem(false);
+    jit = runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x8000'0080);
+    Cpu::Jit::SetFastmem(true);
+    assert(interp == jit);
+
+    // stores from recompiled code still mark their page dirty
+    code = {
+        Cpu::Asm::AsmInstruction("SW R5 0 R9"),
+        Cpu::Asm::AsmInstruction("J 0x400c"),
+        0,
+    };
+    runProgram(Cpu::ExecMode::Recompiler, code, regs, {}, 0x400c);
+    Ram::TakeDirtyPages();
+    Cpu::SetPC(ProgBase);
+    while (Cpu::GetPC() != 0x400c) {
+        Cpu::Step();
+    }
+    Ram::DirtyPages dirty = Ram::TakeDirtyPages();
+    assert(dirty.count() == 1 && dirty[DataBase / Ram::DirtyPageSize]);
+}
+
+static void tieredTests()
+{
+    TCPU_INFO("** Starting Tiered Execution Tests --------------------");
+    System::Reset();
+    Cpu::SetExecMode(Cpu::ExecMode::Tiered);
+    Cpu::SetTierThresholds(2, 4);
+
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R1 R1 1"), 0x5000);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("BNE R1 R2 -2"), 0x5004);
+    Bus::Write<u32>(0, 0x5008);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("ADDI R3 R0 7"), 0x500c);
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x5010"), 0x5010);
+    Cpu::SetR(2, 10);
+    Cpu::SetPC(0x5000);
+
+    // first time around the loop is interpreted
+    for (int i = 0; i < 3; i++) {
+        Cpu::Step();
+    }
+    assert(Cpu::GetPC() == 0x5000);
+    assert(Cpu::BlockCache::Lookup(0x5000) == nullptr);
+
+    // then cached
+    for (int i = 0; i < 3; i++) {
+        Cpu::Step();
+    }
+    assert(Cpu::GetR(1) == 2);
+    assert(Cpu::BlockCache::Lookup(0x5000) != nullptr);
+
+    // and recompiled once hot
+    while (Cpu::GetPC() != 0x5010) {
+        Cpu::Step();
+    }
+    assert(Cpu::GetR(1) == 10);
+    assert(Cpu::GetR(3) == 7);
+    assert(!Cpu::Jit::IsSupported() || Cpu::BlockCache::Lookup(0x5000)->jit_fn != nullptr);
+    // code that ran once never got decoded
+    assert(Cpu::BlockCache::Lookup(0x500c) == nullptr);
+
+    //========================
+    // translation cache
+    //========================
+    if (!Cpu::Jit::IsSupported()) {
+        return;
+    }
+    std::string path = (std::filesystem::temp_directory_path() / "psxtest.tcache").string();
+    assert(Cpu::TransCache::NumRecorded() >= 1);
+    assert(Cpu::TransCache::Save(path));
+    Cpu::TransCache::Clear();
+    assert(Cpu::TransCache::Load(path));
+    assert(Cpu::TransCache::NumLoaded() >= 1);
+
+    // the loop is recompiled the first time it runs
+    auto setupLoop = [] (const char *body) {
+        System::Reset();
+        Cpu::SetExecMode(Cpu::ExecMode::Tiered);
+        Cpu::SetTierThresholds(2, 4);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction(body), 0x5000);
+        Bus::Write<u32>(Cpu::Asm::AsmInstruction("BNE R1 R2 -2"), 0x5004);
+        Bus::Write<u32>(0, 0x5008);
+        Cpu::SetR(2, 10);
+        Cpu::SetPC(0x5000);
+    };
+    setupLoop("ADDI R1 R1 1");
+    Cpu::Step();
+    assert(Cpu::TransCache::NumHits() == 1);
+    assert(Cpu::BlockCache::Lookup(0x5000)->jit_fn != nullptr);
+    assert(Cpu::GetR(1) == 1 && Cpu::GetPC() == 0x5000);
+
+    // changed code doesn't match anymore
+    assert(Cpu::TransCache::Load(path));
+    setupLoop("ADDI R1 R1 2");
+    Cpu::Step();
+    assert(Cpu::TransCache::NumHits() == 1);
+    assert(Cpu::BlockCache::Lookup(0x5000) == nullptr);
+
+    // files from other builds get ignored
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(8);
+        file.put('\xff');
+    }
+    assert(!Cpu::TransCache::Load(path));
+    assert(Cpu::TransCache::NumLoaded() == 0);
+    Cpu::TransCache::Clear();
+    std::filesystem::remove(path);
+}
+
+static void fusionTests()
+{
+    TCPU_INFO("** Starting Instruction Fusion Tests ------------------");
+    std::vector<u32> code = {
+        Cpu::Asm::AsmInstruction("LUI R1 0x1234"),
+        Cpu::Asm::AsmInstruction("ORI R1 R1 0x5678"),
+        Cpu::Asm::AsmInstruction("LUI R2 0xffff"),
+        encodeI(0x09, 2, 2, 0x8000), // ADDIU R2 R2 -0x8000
+        // constant built in the load delay slot of the same register
+        Cpu::Asm::AsmInstruction("LW R3 0 R9"),
+        Cpu::Asm::AsmInstruction("LUI R3 0x1111"),
+        Cpu::Asm::AsmInstruction("ORI R3 R3 0x2222"),
+        // absolute addresses, the LUI must win over the load
+        Cpu::Asm::AsmInstruction("LW R5 4 R9"),
+        Cpu::Asm::AsmInstruction("LUI R5 1"),
+        encodeI(0x23, 5, 6, 0x8008), // LW R6 -0x7ff8 R5
+        Cpu::Asm::AsmInstruction("ADDU R7 R6 R0"),
+        Cpu::Asm::AsmInstruction("LUI R5 1"),
+        encodeI(0x2b, 5, 1, 0x800c), // SW R1 -0x7ff4 R5
+        // compare and branch
+        Cpu::Asm::AsmInstruction("SLT R8 R2 R1"),
+        Cpu::Asm::AsmInstruction("BNE R8 R0 2"),
+        Cpu::Asm::AsmInstruction("ADDIU R7 R7 1"),
+        Cpu::Asm::AsmInstruction("ADDIU R7 R7 0x100"),
+        Cpu::Asm::AsmInstruction("J 0x4050"),
+        0,
+        0,
+    };
+    std::vector<u32> data = {0xaaaa, 0xbbbb, 0xcccc};
+    std::vector<u32> regs(8, 0);
+    regs[6] = 0x40;
+    u32 stop_pc = ProgBase + 4 * 20;
+
+    CpuSnapshot interp = runProgram(Cpu::ExecMode::Interpreter, code, regs, data, stop_pc);
+    CpuSnapshot cached = runProgram(Cpu::ExecMode::CachedInterpreter, code, regs, data, stop_pc, true);
+    assert(interp == cached);
+    assert(cached.r[1] == 0x1234'5678);
+    assert(cached.r[2] == 0xfffe'8000);
+    assert(cached.r[3] == 0x1111'2222);
+    assert(cached.r[5] == 0x1'0000);
+    assert(cached.r[6] == 0xcccc);
+    assert(cached.r[7] == 0x41);
+    assert(cached.r[8] == 1);
+    assert(cached.data[3] == 0x1234'5678);
+    assert(Cpu::NumFusedPairs() == 6);
+
+    // single steps never fuse
+    runProgram(Cpu::ExecMode::CachedInterpreter, code, regs, data, stop_pc);
+    assert(Cpu::NumFusedPairs() == 0);
+}
+
 namespace Psx {
 namespace Test {
 
 void CpuTests()
 {
     std::cout << PSX_FANCYTITLE("CPU TESTS");
-    aluiTests();
-    alurTests();
-    shiftTests();
-    hiloTests();
-    loadTests();
-    loadDelayTests();
-    storeTests();
-    jumpTests();
-    branchTests();
+    // every test should pass no matter how the instructions are executed
+    for (Cpu::ExecMode mode : {Cpu::ExecMode::Interpreter, Cpu::ExecMode::CachedInterpreter}) {
+        Cpu::SetExecMode(mode);
+        aluiTests();
+        alurTests();
+        shiftTests();
+        hiloTests();
+        loadTests();
+        loadDelayTests();
+        storeTests();
+        jumpTests();
+        branchTests();
+        runTests();
+    }
+    blockCacheTests();
+    icacheTests();
+    recompilerTests();
+    idleLoopTests();
+    fusionTests();
+    tieredTests();
+    Cpu::SetExecMode(Cpu::ExecMode::Interpreter);
 }
 
 }//end namespace
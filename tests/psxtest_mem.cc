@@ -8,19 +8,27 @@
  */
 
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <vector>
 
 #include "util/psxlog.hh"
 #include "util/psxutil.hh"
+#include "mem/arena.hh"
 #include "mem/bus.hh"
 #include "mem/ram.hh"
 #include "mem/scratchpad.hh"
+#include "bios/bios.hh"
+#include "cpu/cop0.hh"
 
 #include "psxtest.hh"
 
-#define TMEM_INFO(msg) PSXLOG_INFO("Test-Mem", msg)
-#define TMEM_WARN(msg) PSXLOG_WARN("Test-Mem", msg)
-#define TMEM_ERROR(msg) PSXLOG_ERROR("Test-Mem", msg)
+#define TMEM_INFO(...) PSXLOG_INFO("Test-Mem", __VA_ARGS__)
+#define TMEM_WARN(...) PSXLOG_WARN("Test-Mem", __VA_ARGS__)
+#define TMEM_ERROR(...) PSXLOG_ERROR("Test-Mem", __VA_ARGS__)
 
 using namespace Psx;
 
@@ -146,6 +154,168 @@ static void ramTests()
     return;
 }
 
+static void busDispatchTests()
+{
+    TMEM_INFO("Starting bus dispatch tests");
+    Bus::Reset();
+    Ram::Reset();
+
+    // all guest memory comes from the arena
+    assert(Ram::HostPtr() == Arena::RamBase() && Bios::HostPtr() == Arena::BiosBase());
+
+    // RAM mirrors across the whole 8MB window
+    Bus::Write<u32>(0xdead'beef, 0x0000'1234);
+    assert(Bus::Read<u32>(0x0020'1234) == 0xdead'beef);
+    assert(Bus::Read<u32>(0x8060'1234) == 0xdead'beef);
+    assert(Bus::Read<u16>(0xa040'1236) == 0xdead);
+    assert(Bus::Read<u8>(0x0000'1235) == 0xbe);
+    Bus::Write<u8>(0x11, 0xa07f'ffff);
+    assert(Bus::Read<u8>(0x001f'ffff) == 0x11);
+
+    // BIOS in all three segments
+    for (u32 addr : {0x1fc0'0000u, 0x9fc0'0100u, 0xbfc7'fff0u}) {
+        assert(Bus::Read<u32>(addr) == Bios::Read<u32>(addr));
+        assert(Bus::Read<u8>(addr + 3) == Bios::Read<u8>(addr + 3));
+    }
+
+    // nothing mapped here
+    for (u32 addr : {0x0080'0000u, 0x2000'0000u, 0x1f80'2000u, 0xbf80'0000u, 0xc000'0000u, 0xfffe'0000u}) {
+        assert(Bus::Read<u32>(addr, Bus::RWVerbosity::Quiet) == 0);
+        Bus::Write<u32>(0x1234'5678, addr, Bus::RWVerbosity::Quiet);
+        assert(Bus::Read<u32>(addr, Bus::RWVerbosity::Quiet) == 0);
+    }
+
+    // io registers go through the dispatch table, holes stay unmapped
+    Bus::Write<u32>(0x0000'0005, 0x1f80'1074); // I_MASK
+    assert(Bus::Read<u32>(0x1f80'1074) == 0x0000'0005);
+    assert(Bus::Read<u16>(0x1f80'1074) == 0x0005);
+    for (u32 addr : {0x1f80'1030u, 0x1f80'1078u, 0x1f80'1800u, 0x1f80'1ffcu}) {
+        assert(Bus::Read<u32>(addr, Bus::RWVerbosity::Quiet) == 0);
+    }
+
+    // RAM writes are dropped while the cache is isolated, reads still work
+    Bus::Write<u32>(0x1111'1111, 0x0000'2000);
+    Cop0::Mt(1u << 16, 12);
+    for (u32 seg : {0x0000'0000u, 0x8000'0000u, 0xa000'0000u}) {
+        Bus::Write<u32>(0x2222'2222, seg + 0x2000);
+        Bus::Write<u8>(0x33, seg + 0x2001);
+        assert(Bus::Read<u32>(seg + 0x2000) == 0x1111'1111);
+    }
+    Cop0::Mt(0, 12);
+    Bus::Write<u32>(0x2222'2222, 0x8000'2000);
+    assert(Bus::Read<u32>(0x0000'2000) == 0x2222'2222);
+    TMEM_INFO("Finished bus dispatch tests");
+}
+
+static void biosTests()
+{
+    TMEM_INFO("Starting BIOS tests");
+    const std::string path = "/tmp/psxtest_bios.bin";
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        for (u32 i = 0; i < 512 * 1024 / 4; i++) {
+            u32 word = i * 0x9e37'79b9;
+            file.write(reinterpret_cast<const char*>(&word), sizeof(word));
+        }
+    }
+    const u8 *rom = Bios::HostPtr();
+    Bios::LoadFromFile(path);
+    // loaded in place, wherever the image came from
+    assert(Bios::HostPtr() == rom && Bios::IsLoaded());
+    for (u32 i : {0u, 1u, 0x1'0000u, 0x1'ffffu}) {
+        assert(Bus::Read<u32>(0xbfc0'0000 + 4 * i) == i * 0x9e37'79b9);
+        assert(Bus::Read<u32>(0x9fc0'0000 + 4 * i) == i * 0x9e37'79b9);
+    }
+    // loading it again gives the same image
+    Bios::LoadFromFile(path);
+    assert(Bus::Read<u32>(0xbfc0'0004) == 0x9e37'79b9);
+    // writes to the ROM are dropped
+    Bus::Write<u32>(0, 0xbfc0'0004);
+    assert(Bus::Read<u32>(0xbfc0'0004) == 0x9e37'79b9);
+    std::remove(path.c_str());
+    TMEM_INFO("Finished BIOS tests");
+}
+
+static void dirtyPageTests()
+{
+    TMEM_INFO("Starting dirty page tests");
+    Ram::Reset();
+    // everything is dirty after a reset
+    assert(Ram::TakeDirtyPages().all());
+    assert(Ram::TakeDirtyPages().none());
+
+    Bus::Write<u32>(0x1234'5678, 0x0000'0000);
+    Bus::Write<u8>(0x12, 0x8000'0fff);
+    Bus::Write<u16>(0x1234, 0xa060'1000); // mirror
+    Bus::Write<u32>(0x1234'5678, 0x001f'fffc);
+    assert(Ram::PeekDirtyPages().count() == 3);
+    Ram::DirtyPages dirty = Ram::TakeDirtyPages();
+    assert(dirty.count() == 3);
+    assert(dirty[0] && dirty[1] && dirty[dirty.size() - 1]);
+    assert(Ram::PeekDirtyPages().none());
+    TMEM_INFO("Finished dirty page tests");
+}
+
+/*
+ * Little endian access a byte at a time, how Ram/Bios/Scratchpad used to do
+ * it. Only here to compare against Util::LoadLE/StoreLE.
+ */
+template<class T>
+static T byteLoadLE(const u8 *src)
+{
+    T data = 0;
+    for (u32 i = 0; i < sizeof(T); i++) {
+        data = static_cast<T>(data | static_cast<T>(src[i]) << (8 * i));
+    }
+    return data;
+}
+
+template<class T>
+static void byteStoreLE(u8 *dst, T data)
+{
+    for (u32 i = 0; i < sizeof(T); i++) {
+        dst[i] = static_cast<u8>(data >> (8 * i));
+    }
+}
+
+/*
+ * Time sizeof(T) wide store + load passes over a RAM sized buffer with both
+ * kinds of accessors. The timings only get logged, they depend too much on
+ * the host and build type to assert on. Only runs with PSX_BENCH set.
+ */
+template<class T>
+static void accessorBenchmark()
+{
+    using Clock = std::chrono::steady_clock;
+    constexpr u32 BufSize = 2 * 1024 * 1024;
+    constexpr int Passes = 8;
+    std::vector<u8> buf(BufSize);
+
+    auto run = [&buf] (auto load, auto store) {
+        u64 sum = 0;
+        for (int pass = 0; pass < Passes; pass++) {
+            for (u32 off = 0; off < BufSize; off += sizeof(T)) {
+                store(buf.data() + off, static_cast<T>(off + static_cast<u32>(pass)));
+            }
+            for (u32 off = 0; off < BufSize; off += sizeof(T)) {
+                sum += load(buf.data() + off);
+            }
+        }
+        return sum;
+    };
+
+    auto start = Clock::now();
+    u64 byte_sum = run(byteLoadLE<T>, byteStoreLE<T>);
+    auto mid = Clock::now();
+    u64 native_sum = run(Util::LoadLE<T>, Util::StoreLE<T>);
+    auto end = Clock::now();
+    assert(byte_sum == native_sum);
+
+    auto us = [] (auto d) { return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+    TMEM_INFO("{}-bit accessors: byte-wise {}us, native {}us ({} accesses)",
+        8 * sizeof(T), us(mid - start), us(end - mid), 2 * Passes * (BufSize / sizeof(T)));
+}
+
 static void scratchpadTests()
 {
     Scratchpad::Reset();
@@ -234,6 +404,21 @@ static void scratchpadTests()
         read32 = Bus::Read<u32>(addr);
         assert(read32 == write32);
     }
+
+    TMEM_INFO("Testing Scratchpad with the cache isolated");
+    Bus::Write<u32>(0x1234'5678, 0x1f80'0010);
+    Cop0::Mt(1u << 16, 12);
+    Bus::Write<u32>(0xdead'beef, 0x1f80'0010);
+    Bus::Write<u32>(0xdead'beef, 0x9f80'0010);
+    assert(Bus::Read<u32>(0x1f80'0010) == 0x1234'5678);
+    Cop0::Mt(0, 12);
+    Bus::Write<u32>(0xdead'beef, 0x9f80'0010);
+    assert(Bus::Read<u32>(0x1f80'0010) == 0xdead'beef);
+
+    // only the cached segments reach it
+    assert(!Bus::IsBusError(0x1f80'03fc) && !Bus::IsBusError(0x9f80'0000));
+    assert(Bus::IsBusError(0xbf80'0000) && Bus::IsBusError(0xbf80'03ff));
+    assert(!Bus::IsBusError(0xbf80'0400) && !Bus::IsBusError(0xbf80'1070));
     TMEM_INFO("Finished scratchpad tests");
 }
 
@@ -244,9 +429,16 @@ namespace Test {
         std::cout << PSX_FANCYTITLE("MEM TESTS");
         TMEM_INFO("Performing RAM tests");
         ramTests();
-        TMEM_WARN("Ignoring Scratchpad tests until implementation done");
-        // TMEM_INFO("Performing Scratchpad tests");
-        // scratchpadTests();
+        busDispatchTests();
+        dirtyPageTests();
+        biosTests();
+        if (std::getenv("PSX_BENCH") != nullptr) {
+            TMEM_INFO("Benchmarking little endian accessors");
+            accessorBenchmark<u16>();
+            accessorBenchmark<u32>();
+        }
+        TMEM_INFO("Performing Scratchpad tests");
+        scratchpadTests();
     }
 }// end namespace
 }
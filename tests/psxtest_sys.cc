@@ -0,0 +1,360 @@
+/*
+ * psxtest_sys.cc
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Tests for the hardware around the cpu and how it's timed.
+ */
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+
+#include "util/psxutil.hh"
+#include "util/psxlog.hh"
+#include "core/sys.hh"
+#include "core/scheduler.hh"
+#include "cpu/asm/asm.hh"
+#include "cpu/cpu.hh"
+#include "cpu/interrupt.hh"
+#include "gpu/gpu.hh"
+#include "io/timer.hh"
+#include "mem/bus.hh"
+
+#include "psxtest_sys.hh"
+
+#define TSYS_INFO(...) PSXLOG_INFO("Test-Sys", __VA_ARGS__)
+#define TSYS_WARN(...) PSXLOG_WARN("Test-Sys", __VA_ARGS__)
+#define TSYS_ERROR(...) PSXLOG_ERROR("Test-Sys", __VA_ARGS__)
+
+using namespace Psx;
+
+namespace {
+struct Fired {
+    char event;
+    u64 now;
+    u32 late;
+};
+std::vector<Fired> fired;
+Scheduler::EventHandle chained_event;
+
+void eventA(u32 late) { fired.push_back({'A', Scheduler::Now(), late}); }
+void eventB(u32 late) { fired.push_back({'B', Scheduler::Now(), late}); }
+void eventC(u32 late)
+{
+    fired.push_back({'C', Scheduler::Now(), late});
+    // already due, fires in the same advance
+    Scheduler::Schedule(chained_event, 0);
+}
+void eventD(u32 late) { fired.push_back({'D', Scheduler::Now(), late}); }
+}// end namespace
+
+static void schedulerTests()
+{
+    TSYS_INFO("** Starting Scheduler Tests -----------------------");
+    System::Reset();
+    // the video timing's first events are due right away
+    Scheduler::Advance(0);
+    Scheduler::EventHandle a = Scheduler::Register("Test A", eventA);
+    Scheduler::EventHandle b = Scheduler::Register("Test B", eventB);
+    Scheduler::EventHandle c = Scheduler::Register("Test C", eventC);
+    chained_event = Scheduler::Register("Test D", eventD);
+    // registering again gives back the same event
+    assert(Scheduler::Register("Test A", eventA) == a);
+    assert(a != b && b != c && c != chained_event);
+
+    // fires in order of when they're due, with how late they are
+    TSYS_INFO("Ordering");
+    fired.clear();
+    Scheduler::Schedule(c, 30);
+    Scheduler::Schedule(a, 10);
+    Scheduler::Schedule(b, 20);
+    assert(Scheduler::NextSlice(1000) == 10);
+    assert(Scheduler::NextSlice(5) == 5);
+    Scheduler::Advance(5);
+    assert(fired.empty());
+    assert(Scheduler::Now() == 5);
+    Scheduler::Advance(30);
+    assert(fired.size() == 4);
+    assert(fired[0].event == 'A' && fired[0].late == 25);
+    assert(fired[1].event == 'B' && fired[1].late == 15);
+    assert(fired[2].event == 'C' && fired[2].late == 5);
+    assert(fired[3].event == 'D' && fired[3].late == 5);
+    // the time is when each one was due
+    assert(fired[0].now == 10 && fired[1].now == 20);
+    assert(fired[2].now == 30 && fired[3].now == 30);
+    assert(Scheduler::Now() == 35);
+    assert(!Scheduler::IsScheduled(a) && !Scheduler::IsScheduled(chained_event));
+
+    // rescheduling moves the event, cancelling drops it
+    TSYS_INFO("Reschedule and cancel");
+    fired.clear();
+    Scheduler::Schedule(a, 10);
+    Scheduler::Schedule(b, 20);
+    Scheduler::Schedule(a, 50);
+    Scheduler::Advance(20);
+    assert(fired.size() == 1 && fired[0].event == 'B' && fired[0].late == 0);
+    assert(Scheduler::IsScheduled(a));
+    Scheduler::Cancel(a);
+    Scheduler::Cancel(a);
+    assert(!Scheduler::IsScheduled(a));
+    Scheduler::Advance(100);
+    assert(fired.size() == 1);
+
+    // a due event ends the slice right away
+    Scheduler::Schedule(a, 0);
+    assert(Scheduler::NextSlice(1000) == 0);
+    Scheduler::Advance(0);
+    assert(fired.size() == 2 && fired[1].event == 'A');
+
+    // lots of events stay in order
+    TSYS_INFO("Heap order");
+    for (u32 round = 0; round < 64; round++) {
+        fired.clear();
+        Scheduler::Schedule(a, (round * 7) % 13);
+        Scheduler::Schedule(b, (round * 5) % 11);
+        Scheduler::Schedule(chained_event, (round * 3) % 7);
+        Scheduler::Advance(13);
+        assert(fired.size() == 3);
+        assert(fired[0].late >= fired[1].late && fired[1].late >= fired[2].late);
+    }
+
+    // the reset drops everything that was scheduled
+    Scheduler::Schedule(a, 10);
+    System::Reset();
+    assert(!Scheduler::IsScheduled(a));
+    assert(Scheduler::Now() == 0);
+    TSYS_INFO("Finished Scheduler Tests");
+}
+
+/*
+ * First cpu cycle at or after the given gpu cycle.
+ */
+static u64 cpuCycle(u64 gpu_cycle)
+{
+    return (gpu_cycle * 7 + 10) / 11;
+}
+
+/*
+ * Reset with the display ranges and mode the BIOS would set up (GP1(00h)),
+ * the first line's hblank ends right away.
+ */
+static void resetVideo()
+{
+    System::Reset();
+    Bus::Write<u32>(0, 0x1f80'1814);
+    Scheduler::Advance(0);
+}
+
+static void timerTests()
+{
+    TSYS_INFO("** Starting Timer Tests -----------------------");
+    constexpr u32 Value = 0x0;
+    constexpr u32 Mode = 0x4;
+    constexpr u32 Target = 0x8;
+    auto timerAddr = [](u32 timer, u32 reg) { return 0x1f80'1100 + timer * 0x10 + reg; };
+    auto istat = []() { return Bus::Read<u32>(0x1f80'1070); };
+
+    // counts the system clock from when the mode is written
+    TSYS_INFO("System clock");
+    System::Reset();
+    Scheduler::Advance(50);
+    Bus::Write<u32>(0, timerAddr(2, Mode));
+    Scheduler::Advance(1000);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 1000);
+    Bus::Write<u32>(0xfff0, timerAddr(2, Value));
+    Scheduler::Advance(0x10);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 0);
+
+    // 1/8 of the system clock
+    TSYS_INFO("System clock / 8");
+    System::Reset();
+    Bus::Write<u32>(0x200, timerAddr(2, Mode));
+    Scheduler::Advance(87);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 10);
+    Scheduler::Advance(1);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 11);
+
+    // clock source 2 is still the system clock for timer 1
+    TSYS_INFO("Timer 1 system clock");
+    System::Reset();
+    Bus::Write<u32>(0x200, timerAddr(1, Mode));
+    Scheduler::Advance(87);
+    assert(Bus::Read<u32>(timerAddr(1, Value)) == 87);
+
+    // sync modes 0 and 3 stop timer 2
+    TSYS_INFO("Timer 2 sync");
+    System::Reset();
+    Bus::Write<u32>(0x1, timerAddr(2, Mode));
+    Scheduler::Advance(100);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 0);
+    Bus::Write<u32>(0x3, timerAddr(2, Mode));
+    Scheduler::Advance(100);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 100);
+
+    // reset at target with a repeating irq, fires at the exact cycle
+    TSYS_INFO("Target irq");
+    System::Reset();
+    Bus::Write<u32>(500, timerAddr(2, Target));
+    Bus::Write<u32>(0x58, timerAddr(2, Mode));
+    assert((Bus::Read<u32>(timerAddr(2, Mode)) & 0x400) != 0);
+    Scheduler::Advance(499);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 499);
+    assert((istat() & Interrupt::Type::Timer2) == 0);
+    Scheduler::Advance(1);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 0);
+    assert((istat() & Interrupt::Type::Timer2) != 0);
+    // flag is reset by the read
+    assert((Bus::Read<u32>(timerAddr(2, Mode)) & 0x800) != 0);
+    assert((Bus::Read<u32>(timerAddr(2, Mode)) & 0x800) == 0);
+    Bus::Write<u32>(0, 0x1f80'1070);
+    // a late event still counts from the cycle it was due
+    Scheduler::Advance(1230);
+    assert(Bus::Read<u32>(timerAddr(2, Value)) == 230);
+    assert((istat() & Interrupt::Type::Timer2) != 0);
+
+    // one-shot 0xffff irq
+    TSYS_INFO("0xffff irq");
+    System::Reset();
+    Bus::Write<u32>(0x20, timerAddr(0, Mode));
+    Bus::Write<u32>(0xfff0, timerAddr(0, Value));
+    Scheduler::Advance(0xf);
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == 0xffff);
+    assert((Bus::Read<u32>(timerAddr(0, Mode)) & 0x1000) != 0);
+    assert((istat() & Interrupt::Type::Timer0) != 0);
+    Bus::Write<u32>(0, 0x1f80'1070);
+    Scheduler::Advance(0x10000);
+    assert((Bus::Read<u32>(timerAddr(0, Mode)) & 0x1000) != 0);
+    assert((istat() & Interrupt::Type::Timer0) == 0);
+
+    // hblanks from the gpu clock timer 1
+    TSYS_INFO("Hblank clock");
+    resetVideo();
+    Bus::Write<u32>(0x100, timerAddr(1, Mode));
+    Scheduler::Advance(static_cast<u32>(cpuCycle(10 * 3413)));
+    assert(Bus::Read<u32>(timerAddr(1, Value)) == 10);
+
+    // dots at 320 wide, a divider of 8
+    TSYS_INFO("Dot clock");
+    resetVideo();
+    Bus::Write<u32>(0x100, timerAddr(0, Mode));
+    Scheduler::Advance(static_cast<u32>(cpuCycle(100 * 8)));
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == 100);
+
+    // timer 0 synced to hblank, which starts at 0xc00 into the line and ends
+    // at 0x200 into the next one
+    TSYS_INFO("Hblank sync");
+    resetVideo();
+    Bus::Write<u32>(0x3, timerAddr(0, Mode)); // reset at hblank
+    u64 hblank = cpuCycle(0xc00);
+    Scheduler::Advance(static_cast<u32>(hblank + 100));
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == 100);
+    Bus::Write<u32>(0x5, timerAddr(0, Mode)); // only count in hblank
+    u64 mode_write = Scheduler::Now();
+    u64 hblank_end = cpuCycle(3413 + 0x200);
+    Scheduler::Advance(static_cast<u32>(hblank_end + 100 - Scheduler::Now()));
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == hblank_end - mode_write);
+    Bus::Write<u32>(0x7, timerAddr(0, Mode)); // wait for the first hblank
+    hblank = cpuCycle(3413 + 0xc00);
+    Scheduler::Advance(static_cast<u32>(hblank - Scheduler::Now()));
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == 0);
+    Scheduler::Advance(30);
+    assert(Bus::Read<u32>(timerAddr(0, Value)) == 30);
+    assert((Bus::Read<u32>(timerAddr(0, Mode)) & 0x1) == 0);
+    TSYS_INFO("Finished Timer Tests");
+}
+
+static void videoTests()
+{
+    TSYS_INFO("** Starting Video Timing Tests -----------------------");
+    auto vblankIrq = []() { return (Bus::Read<u32>(0x1f80'1070) & Interrupt::Type::Vblank) != 0; };
+
+    // vblank starts on line 256 (0x10 + 240) of 263
+    TSYS_INFO("NTSC");
+    resetVideo();
+    Scheduler::Advance(static_cast<u32>(cpuCycle(256 * 3413) - 1));
+    assert(!vblankIrq());
+    Scheduler::Advance(1);
+    assert(vblankIrq());
+    Bus::Write<u32>(0, 0x1f80'1070);
+    Scheduler::Advance(static_cast<u32>(cpuCycle(263 * 3413) - Scheduler::Now() - 1));
+    assert(Gpu::FrameCount() == 0);
+    Scheduler::Advance(1);
+    assert(Gpu::FrameCount() == 1);
+    assert(!vblankIrq());
+    Scheduler::Advance(static_cast<u32>(cpuCycle((263 + 256) * 3413) - Scheduler::Now()));
+    assert(vblankIrq());
+
+    // 314 lines of 3406 cycles
+    TSYS_INFO("PAL");
+    resetVideo();
+    Bus::Write<u32>(0x0800'0009, 0x1f80'1814);
+    assert(Gpu::IsPal());
+    Scheduler::Advance(static_cast<u32>(cpuCycle(314 * 3406) - 1));
+    assert(Gpu::FrameCount() == 0);
+    Scheduler::Advance(1);
+    assert(Gpu::FrameCount() == 1);
+
+    // fields alternate between 263 and 262 lines
+    TSYS_INFO("Interlace");
+    resetVideo();
+    Bus::Write<u32>(0x0800'0021, 0x1f80'1814);
+    Scheduler::Advance(static_cast<u32>(cpuCycle(263 * 3413)));
+    assert(Gpu::FrameCount() == 1);
+    // odd field
+    assert(Bus::Read<u32>(0x1f80'1814) >> 31 == 0);
+    Scheduler::Advance(static_cast<u32>(cpuCycle(16 * 3413)));
+    assert(Bus::Read<u32>(0x1f80'1814) >> 31 == 1);
+    Scheduler::Advance(static_cast<u32>(cpuCycle((263 + 262) * 3413) - Scheduler::Now() - 1));
+    assert(Gpu::FrameCount() == 1);
+    Scheduler::Advance(1);
+    assert(Gpu::FrameCount() == 2);
+    TSYS_INFO("Finished Video Timing Tests");
+}
+
+static void runCyclesTests(System& psx)
+{
+    TSYS_INFO("** Starting RunCycles Tests -----------------------");
+    System::Reset();
+    // the cpu spins in a loop
+    Bus::Write<u32>(Cpu::Asm::AsmInstruction("J 0x7000"), 0x7000);
+    Bus::Write<u32>(0, 0x7004);
+    Cpu::SetPC(0x7000);
+    // timer 2 counting the system clock
+    Bus::Write<u32>(0, 0x1f80'1124);
+    assert(Bus::Read<u32>(0x1f80'1120) == 0);
+
+    u32 ran = 0;
+    for (u32 i = 0; i < 10; i++) {
+        ran += psx.RunCycles(1000);
+        assert(Scheduler::Now() == ran);
+        // the timer's value comes from the time
+        assert(Bus::Read<u32>(0x1f80'1120) == ran % 0x10000);
+    }
+
+    // a frame runs up to where the gpu starts the next one
+    u64 frames = Gpu::FrameCount();
+    psx.RunFrame();
+    assert(Gpu::FrameCount() == frames + 1);
+    assert(Scheduler::Now() == cpuCycle(263 * 3413));
+    psx.RunFrame();
+    assert(Gpu::FrameCount() == frames + 2);
+    assert(Scheduler::Now() == cpuCycle(2 * 263 * 3413));
+    TSYS_INFO("Finished RunCycles Tests");
+}
+
+namespace Psx {
+namespace Test {
+
+void SysTests(System& psx)
+{
+    std::cout << PSX_FANCYTITLE("SYSTEM TESTS");
+    schedulerTests();
+    timerTests();
+    videoTests();
+    runCyclesTests(psx);
+}
+
+}// end namespace
+}
@@ -0,0 +1,15 @@
+/*
+ * psxtest_sys.hh
+ *
+ * Travis Banken
+ * 10/17/2026
+ *
+ * Header file for the system tests.
+ */
+
+namespace Psx {
+class System;
+namespace Test {
+    void SysTests(System& psx);
+}
+}